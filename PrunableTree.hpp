@@ -1,38 +1,82 @@
 #ifndef __PRUNABLE_TREE_HPP___
 #define __PRUNABLE_TREE_HPP___
 
-#include <memory_resource>
 #include <vector>
 #include <new>
 #include <iostream>
 #include <utility>
 #include <algorithm>
 #include <sstream>
+#include <stdexcept>
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+#include <unordered_set>
+#include <limits>
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
 
 struct TreeNode
 {
     int ind = -1; // index for fixed value
+    uint32_t id = 0; // slot in per-node side arrays, reused after deletion
     bool value = false; // false -> low, true -> high
+    uint32_t n_pruned = 0; // prune calls below node that it survived
 
+    // links next to the label, the fields a descent reads come first
     TreeNode* firstchild = nullptr;
     TreeNode* nextsibling = nullptr;
     TreeNode* previous = nullptr;
+
+    uint64_t hash = 0; // structural hash of subtree, relative to ind
+    size_t n_leaves = 0; // number of leaves in subtree
 };
 
+// nodes are carved from chunks that double in size, large chunks can be backed by transparent huge pages
 class NodePool
 {
     public:
         NodePool()
         {
             this->nodes_allocated = 0; // init
+            this->huge_pages = default_huge_pages();
+        }
+
+        ~NodePool()
+        {
+            free_chunks();
         }
 
+        NodePool(const NodePool&) = delete;
+        NodePool& operator=(const NodePool&) = delete;
+
         TreeNode* new_node(int ind, bool value) 
         {
-            void* mem = pool.allocate(sizeof(TreeNode), alignof(TreeNode));
+            void* mem = nullptr;
+            if (this->free_nodes) // recycle deleted node, possibly from an adopted pool
+            {
+                mem = this->free_nodes;
+                this->free_nodes = this->free_nodes->firstchild;
+            }
+            else
+            {
+                if (this->current == this->current_end)
+                    add_chunk(this->next_chunk_bytes);
+                mem = this->current;
+                this->current += sizeof(TreeNode);
+            }
             TreeNode* node = new (mem) TreeNode;
             node->ind = ind;
             node->value = value;
+            if (free_ids.empty())
+                node->id = this->next_id++;
+            else
+            {
+                node->id = free_ids.back();
+                free_ids.pop_back();
+            }
             ++this->nodes_allocated;
             return node;
         }
@@ -41,13 +85,85 @@ class NodePool
         {
             // do not need to call destructor for POD types
             if (!node) return;
-            pool.deallocate(node, sizeof(TreeNode), alignof(TreeNode));
+            free_ids.push_back(node->id);
+            node->firstchild = this->free_nodes; // keep for reuse, the node may belong to an adopted pool
+            this->free_nodes = node;
             --this->nodes_allocated;
         }
 
+        // take over the memory of other, its nodes stay valid and keep their old ids until renewed
+        void adopt(NodePool& other)
+        {
+            this->chunks.insert(this->chunks.end(), other.chunks.begin(), other.chunks.end());
+            while (other.free_nodes)
+            {
+                TreeNode* node = other.free_nodes;
+                other.free_nodes = node->firstchild;
+                node->firstchild = this->free_nodes;
+                this->free_nodes = node;
+            }
+            this->nodes_allocated += other.nodes_allocated;
+
+            // other starts over, the unused rest of its current chunk stays with this pool
+            other.chunks.clear();
+            other.current = nullptr;
+            other.current_end = nullptr;
+            other.next_chunk_bytes = min_chunk_bytes;
+            other.nodes_allocated = 0;
+            other.next_id = 0;
+            other.free_ids.clear();
+        }
+
+        // give an adopted node an id of this pool
+        void renew_id(TreeNode* node)
+        {
+            node->id = this->next_id++;
+        }
+
         void release() // Clear the pool, all allocated nodes are invalid 
         {
-            pool.release();
+            free_chunks();
+            this->free_nodes = nullptr;
+            this->nodes_allocated = 0;
+            this->next_id = 0;
+            this->free_ids.clear();
+        }
+
+        // back chunks of at least one huge page with transparent huge pages, applies to new chunks
+        void set_huge_pages(bool enable = true)
+        {
+            this->huge_pages = enable;
+        }
+
+        bool huge_pages_enabled() const
+        {
+            return this->huge_pages;
+        }
+
+        // setting of pools created from now on
+        static void set_default_huge_pages(bool enable = true)
+        {
+            default_huge_pages() = enable;
+        }
+
+        // make room for n_nodes more nodes in a single chunk
+        void reserve(size_t n_nodes)
+        {
+            if (static_cast<size_t>(this->current_end - this->current) < n_nodes * sizeof(TreeNode))
+                add_chunk(std::max(n_nodes * sizeof(TreeNode), min_chunk_bytes));
+        }
+
+        void swap(NodePool& other)
+        {
+            std::swap(this->chunks, other.chunks);
+            std::swap(this->current, other.current);
+            std::swap(this->current_end, other.current_end);
+            std::swap(this->next_chunk_bytes, other.next_chunk_bytes);
+            std::swap(this->huge_pages, other.huge_pages);
+            std::swap(this->free_nodes, other.free_nodes);
+            std::swap(this->nodes_allocated, other.nodes_allocated);
+            std::swap(this->next_id, other.next_id);
+            std::swap(this->free_ids, other.free_ids);
         }
 
         size_t size() const
@@ -55,9 +171,215 @@ class NodePool
             return this->nodes_allocated;
         }
 
+        size_t id_bound() const // all node ids are below this bound
+        {
+            return this->next_id;
+        }
+
+        size_t n_chunks() const
+        {
+            return this->chunks.size();
+        }
+
+        size_t bytes_reserved() const
+        {
+            size_t bytes = 0;
+            for (const auto& chunk : this->chunks)
+                bytes += chunk.size;
+            return bytes;
+        }
+
     private:
-        std::pmr::unsynchronized_pool_resource pool;
+        struct Chunk
+        {
+            char* data;
+            size_t size; // bytes
+            bool mapped; // mmap instead of operator new
+        };
+
+        static constexpr size_t min_chunk_bytes = size_t(1) << 12;
+        static constexpr size_t max_chunk_bytes = size_t(1) << 26;
+        static constexpr size_t huge_page_bytes = size_t(1) << 21;
+
+        static bool& default_huge_pages()
+        {
+            static bool enabled = false;
+            return enabled;
+        }
+
+        void add_chunk(size_t bytes)
+        {
+            Chunk chunk = allocate_chunk(bytes, this->huge_pages);
+            this->chunks.push_back(chunk);
+            this->current = chunk.data;
+            this->current_end = chunk.data + (chunk.size / sizeof(TreeNode)) * sizeof(TreeNode);
+            this->next_chunk_bytes = std::min(2 * bytes, max_chunk_bytes); // geometric growth
+        }
+
+        static Chunk allocate_chunk(size_t bytes, bool huge_pages)
+        {
+            #if defined(__linux__)
+            if (huge_pages && bytes >= huge_page_bytes)
+            {
+                // map one extra huge page and trim so that the chunk starts on a huge page boundary
+                size_t size = (bytes + huge_page_bytes - 1) / huge_page_bytes * huge_page_bytes;
+                void* mem = mmap(nullptr, size + huge_page_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+                if (mem != MAP_FAILED)
+                {
+                    uintptr_t start = reinterpret_cast<uintptr_t>(mem);
+                    uintptr_t aligned = (start + huge_page_bytes - 1) / huge_page_bytes * huge_page_bytes;
+                    if (aligned > start)
+                        munmap(mem, aligned - start);
+                    if (start + huge_page_bytes > aligned)
+                        munmap(reinterpret_cast<void*>(aligned + size), start + huge_page_bytes - aligned);
+                    #ifdef MADV_HUGEPAGE
+                    madvise(reinterpret_cast<void*>(aligned), size, MADV_HUGEPAGE); // best effort, small pages otherwise
+                    #endif
+                    return {reinterpret_cast<char*>(aligned), size, true};
+                }
+            }
+            #endif
+            return {static_cast<char*>(::operator new(bytes)), bytes, false};
+        }
+
+        void free_chunks()
+        {
+            for (const auto& chunk : this->chunks)
+            {
+                #if defined(__linux__)
+                if (chunk.mapped)
+                {
+                    munmap(chunk.data, chunk.size);
+                    continue;
+                }
+                #endif
+                ::operator delete(chunk.data);
+            }
+            this->chunks.clear();
+            this->current = nullptr;
+            this->current_end = nullptr;
+            this->next_chunk_bytes = min_chunk_bytes;
+        }
+
+        std::vector<Chunk> chunks; // own and adopted chunks
+        char* current = nullptr; // next free byte in the newest chunk
+        char* current_end = nullptr;
+        size_t next_chunk_bytes = min_chunk_bytes;
+        bool huge_pages = false;
+        TreeNode* free_nodes = nullptr; // deleted nodes, linked through firstchild
         size_t nodes_allocated; // number of nodes allocated
+        uint32_t next_id = 0; // next unused node id
+        std::vector<uint32_t> free_ids; // ids of deleted nodes
+};
+
+struct LinearConstraint
+{
+    std::vector<std::pair<int, double>> coeffs; // (binary, coefficient)
+    double lb = -std::numeric_limits<double>::infinity(); // lb <= sum of coeffs*binaries <= ub
+    double ub = std::numeric_limits<double>::infinity();
+};
+
+// incremental feasibility check of clauses and linear constraints under a partial assignment
+class ConstraintPropagator
+{
+    public:
+        // clause literals are (binary, value) pairs, a clause holds if any literal holds
+        ConstraintPropagator(int n_bins, const std::vector<std::vector<std::pair<int, bool>>>& clauses,
+            const std::vector<LinearConstraint>& constraints)
+        {
+            this->clause_occ.resize(n_bins);
+            this->linear_occ.resize(n_bins);
+
+            for (size_t c=0; c<clauses.size(); c++)
+            {
+                for (const auto& lit : clauses[c])
+                {
+                    check_index(lit.first, n_bins);
+                    this->clause_occ[lit.first].push_back(std::make_pair(c, lit.second));
+                }
+                this->clause_size.push_back(clauses[c].size());
+                this->clause_false.push_back(0);
+                if (clauses[c].empty())
+                    ++this->n_conflicts; // empty clause
+            }
+
+            for (size_t c=0; c<constraints.size(); c++)
+            {
+                // activity bounds with every binary free
+                double min_act = 0.0, max_act = 0.0;
+                for (const auto& term : constraints[c].coeffs)
+                {
+                    check_index(term.first, n_bins);
+                    this->linear_occ[term.first].push_back(std::make_pair(c, term.second));
+                    min_act += std::min(term.second, 0.0);
+                    max_act += std::max(term.second, 0.0);
+                }
+                this->min_act.push_back(min_act);
+                this->max_act.push_back(max_act);
+                this->lb.push_back(constraints[c].lb);
+                this->ub.push_back(constraints[c].ub);
+                if (violated(c))
+                    ++this->n_conflicts;
+            }
+        }
+
+        void assign(int ind, bool value)
+        {
+            for (const auto& occ : this->clause_occ[ind])
+            {
+                if (occ.second != value && ++this->clause_false[occ.first] == this->clause_size[occ.first])
+                    ++this->n_conflicts; // every literal false
+            }
+            for (const auto& occ : this->linear_occ[ind])
+            {
+                bool was_violated = violated(occ.first);
+                this->min_act[occ.first] += (value ? occ.second : 0.0) - std::min(occ.second, 0.0);
+                this->max_act[occ.first] += (value ? occ.second : 0.0) - std::max(occ.second, 0.0);
+                this->n_conflicts += violated(occ.first) - was_violated;
+            }
+        }
+
+        // undo assign(ind, value)
+        void unassign(int ind, bool value)
+        {
+            for (const auto& occ : this->clause_occ[ind])
+            {
+                if (occ.second != value && this->clause_false[occ.first]-- == this->clause_size[occ.first])
+                    --this->n_conflicts;
+            }
+            for (const auto& occ : this->linear_occ[ind])
+            {
+                bool was_violated = violated(occ.first);
+                this->min_act[occ.first] -= (value ? occ.second : 0.0) - std::min(occ.second, 0.0);
+                this->max_act[occ.first] -= (value ? occ.second : 0.0) - std::max(occ.second, 0.0);
+                this->n_conflicts += violated(occ.first) - was_violated;
+            }
+        }
+
+        // true if some constraint cannot be satisfied by any completion
+        bool conflict() const
+        {
+            return this->n_conflicts > 0;
+        }
+
+    private:
+        std::vector<std::vector<std::pair<size_t, bool>>> clause_occ; // per binary: (clause, literal value)
+        std::vector<std::vector<std::pair<size_t, double>>> linear_occ; // per binary: (constraint, coefficient)
+        std::vector<size_t> clause_size, clause_false; // literals and false literals per clause
+        std::vector<double> min_act, max_act, lb, ub; // activity bounds per linear constraint
+        int n_conflicts = 0; // violated clauses and constraints
+
+        bool violated(size_t c) const
+        {
+            const double tol = 1e-9;
+            return this->min_act[c] > this->ub[c] + tol || this->max_act[c] < this->lb[c] - tol;
+        }
+
+        static void check_index(int ind, int n_bins)
+        {
+            if (ind < 0 || ind >= n_bins)
+                throw std::out_of_range("Binary index out of range");
+        }
 };
 
 struct BranchInfo
@@ -66,6 +388,40 @@ struct BranchInfo
     std::vector<std::pair<int, bool>> delta_bins; // leaf binaries
 };
 
+struct PresolveInfo
+{
+    std::vector<int> bin_map; // new index of each old binary, -1 if removed
+    std::vector<std::pair<int, bool>> fixed_bins; // removed binaries fixed in every leaf (old indices)
+};
+
+struct PruneStats
+{
+    size_t n_prunes = 0; // prune calls that removed nodes below a node testing the binary
+    size_t nodes_removed = 0; // total nodes removed by those calls
+    size_t leaves_removed = 0; // total leaves removed by those calls
+    double avg_nodes_removed = 0.0; // running average per call
+    double avg_leaves_removed = 0.0; // running average per call
+};
+
+enum class HcatEncoding
+{
+    OneHot, // one indicator binary per tree, placed after its binaries
+    Logarithmic // ceil(log2(k)) shared indicator binaries after all tree binaries, one bit pattern per tree
+};
+
+struct Alternative
+{
+    int offset; // index of the first binary of the alternative
+    int n_bins; // number of binaries of the alternative
+    int indicator; // indicator binary (one-hot), first shared indicator binary (logarithmic)
+};
+
+enum class ReorderStrategy
+{
+    Static, // greedy order, fewest distinct prefixes at each level
+    Sifting // static order improved by moving one variable at a time
+};
+
 class Tree
 {
     public:
@@ -74,14 +430,17 @@ class Tree
         {
             this->root = node_pool.new_node(-1, false); // empty root
             this->n_bins = 0; // set number of bins
+            update_node(this->root);
         }
         
         Tree(int ind, bool value, int n_bins)
         {
             this->root = node_pool.new_node(ind, value);
             this->n_bins = n_bins; 
+            this->prune_stats.resize(n_bins);
             if (ind >= 0)
                 this->leaves.push_back({this->root, {{ind, value}}}); // add to leaves
+            update_node(this->root);
         }
 
         Tree(const std::vector<std::vector<std::pair<int, bool>>>& leaf_bins)
@@ -89,7 +448,8 @@ class Tree
             // input validity checking
             if (leaf_bins.empty())
             {    
-                Tree();
+                this->root = node_pool.new_node(-1, false); // empty root
+                update_node(this->root);
                 return;
             }
             
@@ -100,16 +460,83 @@ class Tree
                     throw std::invalid_argument("All leaves must have the same number of binaries");
             }
             this->n_bins = n_bins; // set number of bins
+            this->prune_stats.resize(n_bins);
 
             // manually build tree
             this->root = node_pool.new_node(-1, false); // empty root
-            build_from_leaves_helper(this->root, leaf_bins, 0);
+            std::vector<int> order(n_bins);
+            for (int i=0; i<n_bins; i++)
+                order[i] = i; // branch on bins in index order
+            build_from_leaves_helper(this->root, leaf_bins, 0, order);
+            update_subtree(this->root);
+        }
+
+        // feasible assignments of clauses and linear constraints, built depth first without enumerating infeasible leaves.
+        // A tree cannot hold the empty assignment, so at least one binary is required
+        Tree(int n_bins, const std::vector<std::vector<std::pair<int, bool>>>& clauses, const std::vector<LinearConstraint>& constraints = {})
+        {
+            if (n_bins < 1)
+                throw std::invalid_argument("Constraint tree must have at least one binary");
+
+            this->n_bins = n_bins; // set number of bins
+            this->prune_stats.resize(n_bins);
+            this->root = node_pool.new_node(-1, false); // empty root
+
+            ConstraintPropagator propagator(n_bins, clauses, constraints);
+            std::vector<std::pair<int, bool>> bins; // init
+            if (!propagator.conflict())
+                build_from_constraints_helper(this->root, 0, propagator, bins);
+            update_subtree(this->root);
+        }
+
+        // assignments of n_bins binaries with lb <= number of true binaries <= ub, same layout as the leaf constructor.
+        // A tree cannot hold the empty assignment, so at least one binary is required
+        static Tree cardinality(int n_bins, int lb, int ub)
+        {
+            if (n_bins < 1)
+                throw std::invalid_argument("Cardinality tree must have at least one binary");
+
+            Tree new_tree; // empty root
+            new_tree.n_bins = n_bins;
+            new_tree.prune_stats.resize(n_bins);
+            lb = std::max(lb, 0);
+            ub = std::min(ub, n_bins);
+            if (lb <= ub)
+            {
+                std::vector<std::pair<int, bool>> bins; // init
+                new_tree.build_cardinality_helper(new_tree.root, 0, 0, lb, ub, bins);
+            }
+            new_tree.update_subtree(new_tree.root);
+            return new_tree;
+        }
+
+        static Tree exactly_one(int n_bins)
+        {
+            return cardinality(n_bins, 1, 1);
+        }
+
+        static Tree at_most_k(int n_bins, int k)
+        {
+            return cardinality(n_bins, 0, k);
+        }
+
+        static Tree exactly_k(int n_bins, int k)
+        {
+            return cardinality(n_bins, k, k);
         }
 
         Tree(const Tree& other) // copy 
         {
             this->n_bins = other.n_bins;   
+            this->prune_stats = other.prune_stats;
+            this->track_fixings = other.track_fixings;
+            this->track_labels = other.track_labels;
+            this->alternatives = other.alternatives;
+            this->symmetry_classes = other.symmetry_classes;
+            this->hcat_encoding = other.hcat_encoding;
             this->root = traverse_and_copy(other.root, nullptr, std::vector<std::pair<int, bool>>());
+            copy_leaf_weights(other);
+            update_subtree(this->root);
         }
 
         // copy assignment operator
@@ -120,7 +547,16 @@ class Tree
                 this->node_pool.release(); // clear node pool
                 this->leaves.clear(); // clear leaves
                 this->n_bins = other.n_bins; // copy number of bins
+                this->prune_stats = other.prune_stats;
+                this->track_fixings = other.track_fixings;
+                this->track_labels = other.track_labels;
+                this->alternatives = other.alternatives;
+                this->symmetry_classes = other.symmetry_classes;
+                this->hcat_encoding = other.hcat_encoding;
                 this->root = traverse_and_copy(other.root, nullptr, std::vector<std::pair<int, bool>>()); // copy tree
+                this->track_weights = false; // ids start over
+                copy_leaf_weights(other);
+                update_subtree(this->root);
             }
             return *this;
         }
@@ -136,11 +572,21 @@ class Tree
             return leaf_bins;
         }
 
-        // prune from node
-        void prune(TreeNode* node)
+        // prune from node. With set_auto_shrink enabled the pool may be compacted afterwards, which moves every
+        // node: pointers to nodes, including other branches of this tree, are invalid after the call
+        void prune(TreeNode* node, bool orbit = false)
         {
-            prune_down(node->firstchild); // delete children
-            prune_up(node); // delete node
+            if (!orbit || this->symmetry_classes.empty())
+            {
+                prune_nodes({node});
+                return;
+            }
+
+            // same branch in every alternative of the symmetry class
+            std::vector<TreeNode*> nodes = get_orbit(node);
+            std::vector<std::vector<size_t>> symmetry_classes = this->symmetry_classes;
+            prune_nodes(nodes);
+            this->symmetry_classes.swap(symmetry_classes); // pruned alike, still symmetric
         }
 
         // prune tree from given leaf indices
@@ -154,168 +600,2365 @@ class Tree
                     throw std::out_of_range("Leaf index out of range");
                 leaf_nodes.push_back(this->leaves[ind].first);
             }
+            std::sort(leaf_nodes.begin(), leaf_nodes.end());
+            leaf_nodes.erase(std::unique(leaf_nodes.begin(), leaf_nodes.end()), leaf_nodes.end());
 
             // delete leaves and update tree
-            auto it = this->leaves.begin();
-            while (it != this->leaves.end())
+            prune_nodes(leaf_nodes);
+        }
+
+        // prune the leaves with indices in [begin, end), pruned subtrees are removed as a whole
+        void prune_leaves(size_t begin, size_t end)
+        {
+            if (begin > end || end > this->leaves.size())
+                throw std::out_of_range("Leaf range out of range");
+            if (begin == end)
+                return;
+
+            // largest subtrees covering the range
+            std::vector<TreeNode*> nodes;
+            cover_leaf_range(this->root, 0, begin, end, nodes);
+            prune_nodes(nodes);
+        }
+
+        // leaves below node occupy [first, second) in the leaf list, which is kept in preorder
+        std::pair<size_t, size_t> leaf_range(const TreeNode* node) const
+        {
+            size_t begin = leaves_before(node);
+            return std::make_pair(begin, begin + node->n_leaves);
+        }
+
+        // pruning statistics indexed by binary, contiguous so branching rules can read them directly. Holds
+        // one entry per binary from construction on
+        const std::vector<PruneStats>& get_prune_stats() const
+        {
+            return this->prune_stats;
+        }
+
+        void clear_prune_stats()
+        {
+            this->prune_stats.assign(this->n_bins, PruneStats());
+        }
+
+        // order the children of node so that the branch least likely to be pruned comes first
+        void order_children(TreeNode* node)
+        {
+            std::vector<TreeNode*> children;
+            for (TreeNode* child = node->firstchild; child; child = child->nextsibling)
+                children.push_back(child);
+            std::stable_sort(children.begin(), children.end(), [this](const TreeNode* a, const TreeNode* b)
             {
-                if (std::find(leaf_nodes.begin(), leaf_nodes.end(), it->first) != leaf_nodes.end())
-                {
-                    // recursively delete nodes
-                    prune(it->first);
-                    
-                    // remove leaf from leaves
-                    it = this->leaves.erase(it); // remove from leaves
-                }
-                else
-                {
-                    ++it; // move to next leaf
-                }
+                return prune_order_less(a, b);
+            });
+
+            std::pair<size_t, size_t> range = leaf_range(node);
+            TreeNode* last = nullptr;
+            node->firstchild = nullptr;
+            for (TreeNode* child : children)
+            {
+                child->nextsibling = nullptr;
+                append_child(node, last, child);
             }
+            order_leaf_slice(node, range);
         }
 
-        // root node
-        TreeNode* get_root() const
+        // reorder siblings along the pruned path after every prune call
+        void set_adaptive_order(bool enable = true)
         {
-            return this->root;
+            this->adaptive_order = enable;
         }
 
-        // get subtrees from provided subtree
-        std::vector<BranchInfo> get_branch_info(const TreeNode* node) const
+        // back future node chunks with transparent huge pages where available
+        void use_huge_pages(bool enable = true)
         {
-            return get_branch_info_helper(node, std::vector<std::pair<int, bool>>());
+            this->node_pool.set_huge_pages(enable);
         }
 
-        // get methods
-        size_t get_n_nodes() const
+        // copy the live nodes in preorder into a single chunk and return the old chunks to the system,
+        // returns the number of bytes released. Annotations are kept, pointers to nodes are invalidated
+        size_t shrink_to_fit()
         {
-            return this->node_pool.size(); // return number of nodes
+            size_t reserved = this->node_pool.bytes_reserved();
+            NodePool pool;
+            pool.set_huge_pages(this->node_pool.huge_pages_enabled());
+            pool.reserve(this->node_pool.size());
+
+            std::vector<uint64_t> fixings; // rows by new node id
+            if (this->track_fixings)
+                fixings.assign(this->node_pool.size() * 2 * fixings_words(), 0);
+            std::vector<double> weights; // rows by new node id
+            if (this->track_weights)
+                weights.assign(this->node_pool.size() * 2, 0.0);
+            std::vector<TreeNode*> new_leaves; // preorder, like leaves
+            this->root = compact_helper(this->root, pool, fixings, weights, new_leaves);
+            for (size_t i=0; i<this->leaves.size(); i++)
+                this->leaves[i].first = new_leaves[i];
+            this->fixings.swap(fixings);
+            this->weights.swap(weights);
+            this->lca_depth.clear(); // ids changed
+
+            this->node_pool.swap(pool); // old chunks are freed with pool
+            if (this->track_labels)
+                label_tree(); // rows by new node id
+            size_t kept = this->node_pool.bytes_reserved();
+            return (reserved > kept) ? reserved - kept : 0;
         }
 
-        size_t get_n_bins() const
+        // call shrink_to_fit after a prune that leaves less than min_live_fraction of the reserved node memory
+        // in use, 0 disables. Applies to prune, prune_leaves, prune_above, prune_infeasible and remove_alternative,
+        // pointers to nodes do not survive such a call
+        void set_auto_shrink(double min_live_fraction)
         {
-            return this->n_bins; // return number of bins
+            this->auto_shrink = min_live_fraction;
         }
-        
-        // friend function declarations
-        friend Tree vcat(const Tree& tree1, const Tree& tree2);
-        friend Tree hcat(const std::vector<Tree>& trees);
-        friend std::ostream& operator<<(std::ostream& os, const Tree& tree);
 
-        #ifdef PRUNABLE_TREE_DEBUG
-        std::vector<std::vector<std::pair<int, bool>>> get_leaf_bins_propagate() const
+        // add a leaf for the assignment, the existing prefix is shared if the bins come in branching order. If the
+        // whole assignment is such a prefix, its last node becomes the leaf and the leaves below it are dropped
+        // since it contains them. Returns false if an existing leaf already contains the assignment, in any order
+        // of its bins
+        bool insert_leaf(const std::vector<std::pair<int, bool>>& leaf_bins, double weight = 0.0)
         {
-            std::vector<std::vector<std::pair<int, bool>>> leaf_bins; // init
-            get_leaf_bins_propagate_helper(this->root, leaf_bins, std::vector<std::pair<int, bool>>());
-            return leaf_bins;
+            TreeNode* leaf = insert_leaf_helper(leaf_bins, weight);
+            if (!leaf)
+                return false;
+            this->lca_depth.clear(); // structure changed
+            clear_alternatives(); // leaf may lie outside every alternative
+            place_new_leaf(leaf);
+            update_path(leaf);
+            if (this->track_labels)
+                label_new_branch(leaf);
+            return true;
         }
 
-        std::string print_propagated_leaves() const
+        // add leaves for several assignments, returns number of leaves added
+        size_t insert_leaves(const std::vector<std::vector<std::pair<int, bool>>>& leaf_bins)
         {
-            std::stringstream ss;
-            std::vector<std::vector<std::pair<int, bool>>> leaf_bins = get_leaf_bins_propagate();
-            for (auto it=leaf_bins.begin(); it!=leaf_bins.end(); ++it)
+            // place and update paths for small batches, rebuild the whole tree otherwise
+            bool small = leaf_bins.size() < this->root->n_leaves;
+            size_t n_added = 0;
+            for (const auto& bins : leaf_bins)
             {
-                std::sort(it->begin(), it->end(), [](const std::pair<int, bool>& a, const std::pair<int, bool>& b)
+                TreeNode* leaf = insert_leaf_helper(bins, 0.0);
+                if (!leaf)
+                    continue;
+                ++n_added;
+                if (small)
                 {
-                    return a.first < b.first;
-                });
+                    place_new_leaf(leaf);
+                    update_path(leaf);
+                    if (this->track_labels)
+                        label_new_branch(leaf);
+                }
             }
+            if (n_added == 0)
+                return 0;
 
-            for (const auto& leaf : leaf_bins)
+            this->lca_depth.clear(); // structure changed
+            clear_alternatives(); // leaves may lie outside every alternative
+            if (!small)
             {
-                ss << "Leaf: ";
-                for (const auto& bin : leaf)
-                {
-                    ss << "(" << bin.first << ", " << bin.second << ") ";
-                }
-                ss << std::endl;
+                update_subtree(this->root);
+                rebuild_leaves();
             }
-            return ss.str();
+            return n_added;
         }
-        #endif        
-
-    private:
-        NodePool node_pool;
-        TreeNode* root = nullptr;
-        std::vector<std::pair<TreeNode*, std::vector<std::pair<int, bool>>>> leaves;
-        int n_bins = 0; // number of variables
 
-        // shift index function
-        int shift_index(int ind, int offset)
+        // prune every branch whose path violates a clause or linear constraint, returns number of leaves removed
+        size_t prune_infeasible(const std::vector<std::vector<std::pair<int, bool>>>& clauses, const std::vector<LinearConstraint>& constraints = {})
         {
-            return (ind < 0 ? ind : ind + offset);
+            ConstraintPropagator propagator(this->n_bins, clauses, constraints);
+            std::vector<TreeNode*> pruned_nodes;
+            prune_infeasible_helper(this->root, propagator, pruned_nodes);
+
+            size_t n_leaves = this->root->n_leaves;
+            prune_nodes(pruned_nodes);
+            return n_leaves - this->root->n_leaves;
         }
-        
-        // traverse and copy
-        TreeNode* traverse_and_copy(TreeNode* copy_node, TreeNode* prev_node, const std::vector<std::pair<int, bool>>& bins, int offset=0)
+
+        // keep a weight per leaf and the weight range per node, every leaf starts at 0. Setting a weight
+        // enables this, disabling frees the weights
+        void track_leaf_weights(bool enable = true)
         {
-            if (!copy_node)
+            if (enable)
+                enable_weights();
+            else
             {
-                this->leaves.push_back(std::make_pair(prev_node, bins)); // add to leaves
-                return nullptr;
+                this->track_weights = false;
+                std::vector<double>().swap(this->weights);
             }
+        }
 
-            // check for empty node
-            if (prev_node && copy_node->ind < 0)
-                return traverse_and_copy(copy_node->firstchild, prev_node, bins, offset); // skip empty node
+        // leaf weights
+        void set_leaf_weight(TreeNode* leaf, double weight)
+        {
+            if (leaf->firstchild)
+                throw std::invalid_argument("Node is not a leaf");
+            enable_weights();
+            set_weight(leaf, weight);
+            update_path(get_parent(leaf));
+        }
 
-            // copy current node
-            TreeNode* new_node = node_pool.new_node(shift_index(copy_node->ind, offset), copy_node->value);
-            new_node->previous = prev_node; // set previous node
+        // set weights in the order of the leaves
+        void set_leaf_weights(const std::vector<double>& weights)
+        {
+            if (weights.size() != this->leaves.size())
+                throw std::invalid_argument("Number of weights must match the number of leaves");
+            enable_weights();
+            for (size_t i=0; i<weights.size(); i++)
+                set_weight(this->leaves[i].first, weights[i]);
+            update_subtree(this->root);
+        }
 
-            // copy siblings if they exist
-            if (copy_node->nextsibling)
-                new_node->nextsibling = traverse_and_copy(copy_node->nextsibling, new_node, bins, offset);
+        double get_leaf_weight(const TreeNode* leaf) const
+        {
+            return min_weight(leaf);
+        }
+
+        // k leaves with the smallest weights, in increasing order of weight
+        std::vector<TreeNode*> top_k(size_t k) const
+        {
+            std::vector<TreeNode*> best; // init
+            if (this->root->n_leaves == 0)
+                return best;
+
+            // best first search on subtree minimum weights
+            auto greater = [this](const TreeNode* a, const TreeNode* b) { return min_weight(a) > min_weight(b); };
+            std::vector<TreeNode*> heap = {this->root};
+            while (!heap.empty() && best.size() < k)
+            {
+                std::pop_heap(heap.begin(), heap.end(), greater);
+                TreeNode* node = heap.back();
+                heap.pop_back();
+                if (!node->firstchild)
+                {
+                    best.push_back(node);
+                    continue;
+                }
+                for (TreeNode* child = node->firstchild; child; child = child->nextsibling)
+                {
+                    heap.push_back(child);
+                    std::push_heap(heap.begin(), heap.end(), greater);
+                }
+            }
+            return best;
+        }
+
+        // leaves with weight below threshold
+        std::vector<TreeNode*> leaves_below(double threshold) const
+        {
+            std::vector<TreeNode*> found; // init
+            if (this->root->n_leaves == 0)
+                return found;
+
+            std::vector<TreeNode*> stack = {this->root};
+            while (!stack.empty())
+            {
+                TreeNode* node = stack.back();
+                stack.pop_back();
+                if (min_weight(node) >= threshold)
+                    continue; // nothing below threshold in subtree
+                if (!node->firstchild)
+                    found.push_back(node);
+                for (TreeNode* child = node->firstchild; child; child = child->nextsibling)
+                    stack.push_back(child);
+            }
+            return found;
+        }
+
+        // prune leaves with weight above threshold, returns number of leaves removed
+        size_t prune_above(double threshold)
+        {
+            size_t n_leaves = this->root->n_leaves;
+            if (n_leaves == 0)
+                return 0;
+
+            // largest subtrees with every leaf above threshold
+            std::vector<TreeNode*> pruned_nodes, stack = {this->root};
+            while (!stack.empty())
+            {
+                TreeNode* node = stack.back();
+                stack.pop_back();
+                if (max_weight(node) <= threshold)
+                    continue; // nothing above threshold in subtree
+                if (min_weight(node) > threshold)
+                {
+                    pruned_nodes.push_back(node);
+                    continue;
+                }
+                for (TreeNode* child = node->firstchild; child; child = child->nextsibling)
+                    stack.push_back(child);
+            }
+
+            prune_nodes(pruned_nodes);
+            return n_leaves - this->root->n_leaves;
+        }
+
+        // binaries on the path from the root to node
+        std::vector<std::pair<int, bool>> get_leaf_bins(const TreeNode* node) const
+        {
+            std::vector<std::pair<int, bool>> bins; // init
+            for (; node; node = get_parent(node))
+            {
+                if (node->ind >= 0) // check if non-empty
+                    bins.push_back(std::make_pair(node->ind, node->value));
+            }
+            std::reverse(bins.begin(), bins.end());
+            return bins;
+        }
+
+        // root node
+        TreeNode* get_root() const
+        {
+            return this->root;
+        }
+
+        // get subtrees from provided subtree
+        std::vector<BranchInfo> get_branch_info(const TreeNode* node, bool representatives = false) const
+        {
+            std::vector<BranchInfo> children_info = get_branch_info_helper(node, std::vector<std::pair<int, bool>>());
+            if (!representatives || this->symmetry_classes.empty())
+                return children_info;
+
+            // drop branches that only lead to alternatives represented elsewhere
+            std::unordered_set<const TreeNode*> keep, drop;
+            for (const auto& symmetry_class : this->symmetry_classes)
+            {
+                bool first = true;
+                for (size_t i : symmetry_class)
+                {
+                    const TreeNode* alt_node = find_alternative(i);
+                    if (!alt_node)
+                        continue;
+                    for (const TreeNode* prev = alt_node; prev; prev = get_parent(prev))
+                        (first ? keep : drop).insert(prev);
+                    first = false;
+                }
+            }
+            auto it = std::remove_if(children_info.begin(), children_info.end(), [&](const BranchInfo& info)
+            {
+                return drop.count(info.node) && !keep.count(info.node);
+            });
+            children_info.erase(it, children_info.end());
+            return children_info;
+        }
+
+        // merge siblings with equal labels in place, returns number of nodes removed
+        size_t reduce()
+        {
+            size_t n_nodes = this->node_pool.size();
+            std::unordered_map<uint64_t, std::pair<TreeNode*, bool>> labels; // scratch, reused on every level
+            reduce_helper(this->root, labels);
+            update_subtree(this->root);
+            rebuild_leaves();
+            return n_nodes - this->node_pool.size();
+        }
+
+        // rebuild the tree branching on the binaries in a better order, returns order[level] = binary. budget
+        // bounds the column scans (one pass over the leaves for one binary) of the static and sifting phases,
+        // leaf weights are kept
+        std::vector<int> reorder(ReorderStrategy strategy = ReorderStrategy::Sifting, size_t budget = 100000)
+        {
+            // leaves must assign every binary
+            std::vector<std::vector<std::pair<int, bool>>> leaf_bins; // init
+            std::vector<std::vector<bool>> columns(this->n_bins, std::vector<bool>(this->leaves.size()));
+            for (size_t i=0; i<this->leaves.size(); i++)
+            {
+                std::vector<std::pair<int, bool>> dense(this->n_bins, std::make_pair(-1, false));
+                for (const auto& bin : this->leaves[i].second)
+                    dense[bin.first] = bin;
+                for (int j=0; j<this->n_bins; j++)
+                {
+                    if (dense[j].first < 0)
+                        throw std::invalid_argument("Reordering requires every leaf to assign all binaries");
+                    columns[j][i] = dense[j].second;
+                }
+                leaf_bins.push_back(dense);
+            }
+
+            // search for order
+            std::vector<int> order = greedy_order(columns, budget);
+            size_t best = count_prefixes(columns, order);
+            std::vector<int> identity(this->n_bins);
+            for (int i=0; i<this->n_bins; i++)
+                identity[i] = i;
+            size_t identity_count = count_prefixes(columns, identity);
+            if (identity_count < best)
+            {
+                order = identity;
+                best = identity_count;
+            }
+            if (strategy == ReorderStrategy::Sifting)
+                sift_order(columns, order, best, budget);
+
+            // weights by old leaf index, ids start over
+            bool had_weights = this->track_weights;
+            std::vector<double> leaf_weights;
+            if (had_weights)
+            {
+                for (const auto& leaf : this->leaves)
+                    leaf_weights.push_back(get_leaf_weight(leaf.first));
+            }
+
+            // rebuild
+            this->node_pool.release(); // clear node pool
+            this->leaves.clear(); // clear leaves
+            track_leaf_weights(false);
+            clear_alternatives(); // indicators no longer at the root
+            this->root = node_pool.new_node(-1, false); // empty root
+            if (!leaf_bins.empty())
+                build_from_leaves_helper(this->root, leaf_bins, 0, order);
+
+            // reattach weights, duplicate leaves keep the smallest
+            if (had_weights)
+            {
+                enable_weights();
+                std::vector<bool> seen(this->node_pool.id_bound(), false);
+                std::vector<bool> assignment(this->n_bins);
+                for (size_t i=0; i<leaf_weights.size(); i++)
+                {
+                    for (int j=0; j<this->n_bins; j++)
+                        assignment[j] = columns[j][i];
+                    const TreeNode* leaf = find_leaf(assignment);
+                    if (!seen[leaf->id] || leaf_weights[i] < min_weight(leaf))
+                        set_weight(leaf, leaf_weights[i]);
+                    seen[leaf->id] = true;
+                }
+            }
+            update_subtree(this->root);
+            return order;
+        }
+
+        // assignments to keep_bins that extend to some leaf, other binaries are dropped. If every assignment
+        // extends, the result branches on both values of the first kept binary (binary 0 if none is kept)
+        Tree project(const std::vector<int>& keep_bins) const
+        {
+            std::vector<bool> keep(this->n_bins, false);
+            for (int ind : keep_bins)
+            {
+                if (ind < 0 || ind >= this->n_bins)
+                    throw std::out_of_range("Binary index out of range");
+                keep[ind] = true;
+            }
+
+            Tree new_tree; // empty root
+            new_tree.n_bins = this->n_bins;
+            new_tree.prune_stats.resize(this->n_bins);
+            if (this->root->ind < 0 && !this->root->firstchild)
+                return new_tree; // empty
+
+            // virtual root so that a labelled root is handled like any other child
+            TreeNode root;
+            root.firstchild = (this->root->ind < 0) ? this->root->firstchild : this->root;
+
+            std::vector<bool> full; // per result node id, set once the node became a leaf
+            new_tree.project_helper(&root, new_tree.root, keep, full);
+
+            // every assignment extends to a leaf, spelled out on one binary so that the tree does not read as empty
+            if (!new_tree.root->firstchild)
+            {
+                int ind = keep_bins.empty() ? 0 : *std::min_element(keep_bins.begin(), keep_bins.end());
+                TreeNode* last = nullptr;
+                for (bool value : {false, true})
+                    append_child(new_tree.root, last, new_tree.node_pool.new_node(ind, value));
+            }
+            new_tree.update_subtree(new_tree.root);
+            new_tree.rebuild_leaves();
+            return new_tree;
+        }
+
+        // sort siblings by (ind, value) and merge duplicate siblings
+        void canonicalize()
+        {
+            std::unordered_map<uint64_t, std::pair<TreeNode*, bool>> labels; // scratch
+            reduce_helper(this->root, labels);
+            canonicalize_helper(this->root);
+            update_subtree(this->root);
+            rebuild_leaves();
+        }
+
+        // keep masks of the binaries fixed in every leaf below each node
+        void track_implied_fixings(bool enable = true)
+        {
+            this->track_fixings = enable;
+            if (enable)
+                update_subtree(this->root);
+            else
+                std::vector<uint64_t>().swap(this->fixings);
+        }
+
+        // binaries with the same value in every leaf below node, including the path to node
+        std::vector<std::pair<int, bool>> get_implied_fixings(const TreeNode* node) const
+        {
+            if (!this->track_fixings)
+                throw std::logic_error("Implied fixings are not tracked, call track_implied_fixings() first");
+
+            std::vector<std::pair<int, bool>> fixed_bins; // init
+            const uint64_t* fixed = fixed_mask(node);
+            const uint64_t* values = fixed + fixings_words();
+            for (size_t w=0; w<fixings_words(); w++)
+            {
+                uint64_t bits = fixed[w];
+                while (bits)
+                {
+                    int bit = __builtin_ctzll(bits);
+                    int ind = static_cast<int>(w*64) + bit;
+                    fixed_bins.push_back(std::make_pair(ind, static_cast<bool>((values[w] >> bit) & 1)));
+                    bits &= bits - 1;
+                }
+            }
+            return fixed_bins;
+        }
+
+        // binaries with the same value in every leaf
+        std::vector<std::pair<int, bool>> get_global_fixings() const
+        {
+            return get_implied_fixings(this->root);
+        }
+
+        // remove binaries fixed in every leaf and renumber the remaining binaries densely. If a leaf tests only
+        // fixed binaries every assignment of the rest is feasible, the first fixed binary is then kept as a root
+        // leaf so that the tree does not read as empty
+        PresolveInfo presolve()
+        {
+            PresolveInfo info; // init
+            bool nonempty = this->root->ind >= 0 || this->root->firstchild;
+
+            // global fixings
+            bool tracked = this->track_fixings;
+            if (!tracked)
+                track_implied_fixings(true);
+            info.fixed_bins = get_global_fixings();
+
+            // binaries in use
+            std::vector<bool> used(this->n_bins, false);
+            std::vector<bool> fixed(this->n_bins, false);
+            mark_used_bins(this->root, used);
+            for (const auto& bin : info.fixed_bins)
+                fixed[bin.first] = true;
+
+            // remove fixed nodes
+            if (this->root->ind >= 0 && fixed[this->root->ind])
+                this->root->ind = -1; // fixed root label
+            presolve_helper(this->root, fixed);
+            if (nonempty && this->root->ind < 0 && !this->root->firstchild)
+            {
+                std::pair<int, bool> bin = info.fixed_bins[0];
+                info.fixed_bins.erase(info.fixed_bins.begin());
+                fixed[bin.first] = false;
+                this->root->ind = bin.first;
+                this->root->value = bin.second;
+            }
+
+            // renumber
+            info.bin_map.assign(this->n_bins, -1);
+            int n_kept = 0;
+            for (int i=0; i<this->n_bins; i++)
+            {
+                if (used[i] && !fixed[i])
+                    info.bin_map[i] = n_kept++;
+            }
+            std::unordered_map<uint64_t, std::pair<TreeNode*, bool>> labels; // scratch
+            reduce_helper(this->root, labels);
+            renumber_helper(this->root, info.bin_map);
+
+            // statistics follow the renumbering
+            std::vector<PruneStats> stats(n_kept);
+            for (size_t i=0; i<this->prune_stats.size(); i++)
+            {
+                if (info.bin_map[i] >= 0)
+                    stats[info.bin_map[i]] = this->prune_stats[i];
+            }
+            this->prune_stats.swap(stats);
+
+            this->n_bins = n_kept;
+            clear_alternatives(); // binaries renumbered
+            if (!tracked)
+                track_implied_fixings(false);
+            update_subtree(this->root);
+            rebuild_leaves();
+            return info;
+        }
+
+        // lowest common ancestor of two nodes
+        const TreeNode* lca(const TreeNode* node1, const TreeNode* node2) const
+        {
+            build_lca_index();
+
+            // lift deeper node to the same depth
+            if (this->lca_depth[node1->id] < this->lca_depth[node2->id])
+                std::swap(node1, node2);
+            int diff = this->lca_depth[node1->id] - this->lca_depth[node2->id];
+            for (int k=0; diff; k++, diff >>= 1)
+            {
+                if (diff & 1)
+                    node1 = this->lca_up[node1->id * this->lca_log + k];
+            }
+            if (node1 == node2)
+                return node1;
+
+            // lift both below the common ancestor
+            for (int k=this->lca_log-1; k>=0; k--)
+            {
+                const TreeNode* up1 = this->lca_up[node1->id * this->lca_log + k];
+                const TreeNode* up2 = this->lca_up[node2->id * this->lca_log + k];
+                if (up1 != up2)
+                {
+                    node1 = up1;
+                    node2 = up2;
+                }
+            }
+            return this->lca_up[node1->id * this->lca_log];
+        }
+
+        // keep preorder interval labels per node for constant time ancestor checks, disabling frees them
+        void track_preorder_labels(bool enable = true)
+        {
+            this->track_labels = enable;
+            if (enable)
+                label_tree();
+            else
+                std::vector<uint64_t>().swap(this->preorder_labels);
+        }
+
+        // check if node1 is node2 or one of its ancestors, two comparisons if preorder labels are tracked
+        bool is_ancestor(const TreeNode* node1, const TreeNode* node2) const
+        {
+            if (this->track_labels)
+            {
+                const uint64_t* label1 = preorder_label(node1);
+                const uint64_t* label2 = preorder_label(node2);
+                return label1[0] <= label2[0] && label2[1] <= label1[1];
+            }
+            for (const TreeNode* prev = node2; prev; prev = get_parent(prev))
+            {
+                if (prev == node1)
+                    return true;
+            }
+            return false;
+        }
+
+        // decisions shared by all given leaves, from the root down to where they diverge
+        std::vector<std::pair<int, bool>> common_prefix(const std::vector<const TreeNode*>& leaf_nodes) const
+        {
+            std::vector<std::pair<int, bool>> bins; // init
+            if (leaf_nodes.empty())
+                return bins;
+
+            const TreeNode* node = leaf_nodes[0];
+            for (size_t i=1; i<leaf_nodes.size(); i++)
+                node = lca(node, leaf_nodes[i]);
+            return get_leaf_bins(node);
+        }
+
+        // k-th leaf in preorder (children in sibling order), found through the subtree leaf counts
+        const TreeNode* select_leaf(size_t k) const
+        {
+            if (k >= this->root->n_leaves)
+                throw std::out_of_range("Leaf index out of range");
+
+            const TreeNode* node = this->root;
+            while (node->firstchild)
+            {
+                const TreeNode* child = node->firstchild;
+                while (k >= child->n_leaves)
+                {
+                    k -= child->n_leaves;
+                    child = child->nextsibling;
+                }
+                node = child;
+            }
+            return node;
+        }
+
+        // position of a leaf in preorder, inverse of select_leaf
+        size_t rank(const TreeNode* leaf) const
+        {
+            if (leaf->firstchild || leaf->n_leaves == 0)
+                throw std::invalid_argument("Rank is only defined for leaves");
+            return leaves_before(leaf);
+        }
+
+        // check if a full assignment, one value per binary, lies below a leaf
+        bool contains(const std::vector<bool>& assignment) const
+        {
+            return find_leaf(assignment) != nullptr;
+        }
+
+        // leaf whose path agrees with a full assignment, nullptr if there is none
+        const TreeNode* find_leaf(const std::vector<bool>& assignment) const
+        {
+            if (assignment.size() != static_cast<size_t>(this->n_bins))
+                throw std::invalid_argument("Assignment must have a value for every binary");
+            LookupCursor cursor = {first_lookup_node(), &assignment, 0};
+            if (!cursor.node)
+                return nullptr;
+            while (!lookup_step(cursor)) {}
+            return cursor.node;
+        }
+
+        // find_leaf for many assignments. A window of lookups advances round-robin one node at a time and
+        // prefetches the next node, so the cache misses of independent lookups overlap
+        std::vector<const TreeNode*> find_leaves(const std::vector<std::vector<bool>>& assignments) const
+        {
+            for (const auto& assignment : assignments)
+            {
+                if (assignment.size() != static_cast<size_t>(this->n_bins))
+                    throw std::invalid_argument("Assignment must have a value for every binary");
+            }
+            std::vector<const TreeNode*> found(assignments.size(), nullptr);
+            const TreeNode* start = first_lookup_node();
+            if (!start)
+                return found;
+
+            LookupCursor window[lookup_window];
+            size_t n_active = 0, next = 0;
+            for (; n_active < lookup_window && next < assignments.size(); n_active++, next++)
+                window[n_active] = {start, &assignments[next], next};
+
+            while (n_active > 0)
+            {
+                for (size_t i=0; i<n_active; )
+                {
+                    if (lookup_step(window[i]))
+                    {
+                        found[window[i].query] = window[i].node;
+                        if (next < assignments.size())
+                        {
+                            window[i] = {start, &assignments[next], next}; // refill slot
+                            ++next;
+                        }
+                        else
+                        {
+                            window[i] = window[--n_active]; // shrink window
+                            continue;
+                        }
+                    }
+                    ++i;
+                }
+            }
+            return found;
+        }
+
+        // membership of many assignments, bit i of the result is set if assignment i is contained
+        std::vector<uint64_t> contains_many(const std::vector<std::vector<bool>>& assignments) const
+        {
+            std::vector<const TreeNode*> found = find_leaves(assignments);
+            std::vector<uint64_t> mask((found.size() + 63) / 64, 0);
+            for (size_t i=0; i<found.size(); i++)
+            {
+                if (found[i])
+                    mask[i / 64] |= uint64_t(1) << (i % 64);
+            }
+            return mask;
+        }
+
+        // number of leaves whose path tests every binary of a partial assignment with the given value,
+        // consistent with count_by_variable
+        size_t count(const std::vector<std::pair<int, bool>>& partial_bins) const
+        {
+            std::vector<signed char> assigned(this->n_bins, -1);
+            int n_assigned = 0;
+            for (const auto& bin : partial_bins)
+            {
+                if (bin.first < 0 || bin.first >= this->n_bins)
+                    throw std::out_of_range("Binary index out of range");
+                if (assigned[bin.first] < 0)
+                    ++n_assigned;
+                assigned[bin.first] = bin.second;
+            }
+            return count_helper(this->root, assigned, n_assigned);
+        }
+
+        // number of leaves with each binary false and true, in one pass over the nodes
+        std::vector<std::pair<size_t, size_t>> count_by_variable() const
+        {
+            std::vector<std::pair<size_t, size_t>> counts(this->n_bins, std::make_pair(0, 0));
+            std::vector<const TreeNode*> stack = {this->root};
+            while (!stack.empty())
+            {
+                const TreeNode* node = stack.back();
+                stack.pop_back();
+                if (node->ind >= 0)
+                {
+                    if (node->value)
+                        counts[node->ind].second += node->n_leaves;
+                    else
+                        counts[node->ind].first += node->n_leaves;
+                }
+                for (const TreeNode* child = node->firstchild; child; child = child->nextsibling)
+                    stack.push_back(child);
+            }
+            return counts;
+        }
+
+        size_t get_n_leaves() const
+        {
+            return this->root->n_leaves;
+        }
+
+        // structural hash of the tree
+        uint64_t get_hash() const
+        {
+            return mix_hash(this->root->hash ^ mix_hash(static_cast<uint64_t>(this->root->ind) + (static_cast<uint64_t>(this->n_bins) << 32)));
+        }
+
+        // structural hash of a subtree, invariant to an index offset
+        uint64_t get_hash(const TreeNode* node) const
+        {
+            return node->hash;
+        }
+
+        // check if two subtrees are identical up to an index offset
+        static bool equivalent(const TreeNode* node1, const TreeNode* node2)
+        {
+            return equal_helper(node1, node2);
+        }
+
+        // get methods
+        size_t get_n_nodes() const
+        {
+            return this->node_pool.size(); // return number of nodes
+        }
+
+        size_t get_n_bins() const
+        {
+            return this->n_bins; // return number of bins
+        }
+
+        // alternatives of a tree built by hcat, empty otherwise
+        const std::vector<Alternative>& get_alternatives() const
+        {
+            return this->alternatives;
+        }
+
+        // move tree in as a new one-hot alternative below the root, an empty tree starts a disjunction.
+        // tree is left empty
+        void add_alternative(Tree&& tree)
+        {
+            if (this->alternatives.empty() && (this->root->ind >= 0 || this->root->firstchild))
+                throw std::logic_error("Alternatives can only be added to a disjunction built by hcat or to an empty tree");
+            if (!this->alternatives.empty() && this->hcat_encoding != HcatEncoding::OneHot)
+                throw std::logic_error("Alternatives can only be added to a one-hot disjunction");
+            if (&tree == this)
+                throw std::invalid_argument("Cannot add a tree to itself");
+
+            Alternative alt; // init
+            alt.offset = this->n_bins;
+            alt.n_bins = tree.n_bins;
+            alt.indicator = this->n_bins + tree.n_bins;
+            size_t words = fixings_words();
+            this->n_bins += tree.n_bins + 1;
+            this->hcat_encoding = HcatEncoding::OneHot;
+            this->alternatives.push_back(alt);
+            this->symmetry_classes.clear(); // detect again
+
+            // take over nodes, shift binaries and renew ids
+            this->node_pool.adopt(tree.node_pool);
+            std::vector<std::pair<TreeNode*, double>> leaf_weights; // read under the old ids
+            std::vector<TreeNode*> stack = {tree.root};
+            while (!stack.empty())
+            {
+                TreeNode* node = stack.back();
+                stack.pop_back();
+                if (node->ind >= 0)
+                    node->ind += alt.offset;
+                if (tree.track_weights && !node->firstchild)
+                    leaf_weights.push_back(std::make_pair(node, tree.min_weight(node)));
+                this->node_pool.renew_id(node);
+                for (TreeNode* child = node->firstchild; child; child = child->nextsibling)
+                    stack.push_back(child);
+            }
+
+            // attach below a new indicator
+            TreeNode* indicator = this->node_pool.new_node(alt.indicator, true);
+            TreeNode* last = this->root->firstchild;
+            while (last && last->nextsibling)
+                last = last->nextsibling;
+            append_child(this->root, last, indicator);
+            if (tree.root->ind < 0)
+            {
+                indicator->firstchild = tree.root->firstchild;
+                if (indicator->firstchild)
+                    indicator->firstchild->previous = indicator;
+                this->node_pool.delete_node(tree.root); // empty root
+            }
+            else
+            {
+                indicator->firstchild = tree.root;
+                tree.root->previous = indicator;
+            }
+
+            // weights and statistics follow the nodes
+            if (tree.track_weights)
+                enable_weights();
+            for (const auto& leaf_weight : leaf_weights)
+                set_weight(leaf_weight.first, leaf_weight.second);
+            this->prune_stats.resize(this->n_bins);
+            std::copy(tree.prune_stats.begin(), tree.prune_stats.end(), this->prune_stats.begin() + alt.offset);
+
+            // tree starts over empty
+            tree.leaves.clear();
+            tree.track_leaf_weights(false);
+            tree.clear_alternatives();
+            tree.prune_stats.clear();
+            tree.n_bins = 0;
+            tree.root = tree.node_pool.new_node(-1, false);
+            tree.update_subtree(tree.root);
+
+            // leaves and summaries, the whole tree if the fixings masks grew
+            std::vector<std::pair<int, bool>> bins; // init
+            rebuild_leaves_helper(indicator, bins);
+            if (this->track_fixings && fixings_words() != words)
+                update_subtree(this->root);
+            else
+            {
+                update_subtree(indicator);
+                update_path(this->root);
+            }
+        }
+
+        // drop alternative i of a one-hot disjunction. Its binaries stay reserved until renumber_alternatives().
+        // Deleting its nodes costs its size, on top of that O(k + L) for k alternatives and L leaves: the indicator
+        // and the leaf slice are found by walking the earlier root children, the root summary is recomputed over
+        // all children and the leaves after the slice shift down
+        void remove_alternative(size_t i)
+        {
+            if (i >= this->alternatives.size())
+                throw std::out_of_range("Alternative index out of range");
+            if (this->hcat_encoding != HcatEncoding::OneHot)
+                throw std::logic_error("Alternatives can only be removed from a one-hot disjunction");
+
+            TreeNode* node = find_alternative(i);
+            this->alternatives.erase(this->alternatives.begin() + i);
+
+            // remaining alternatives keep their symmetry
+            for (auto& symmetry_class : this->symmetry_classes)
+            {
+                symmetry_class.erase(std::remove(symmetry_class.begin(), symmetry_class.end(), i), symmetry_class.end());
+                for (size_t& j : symmetry_class)
+                {
+                    if (j > i)
+                        --j;
+                }
+            }
+            this->symmetry_classes.erase(std::remove_if(this->symmetry_classes.begin(), this->symmetry_classes.end(), [](const std::vector<size_t>& symmetry_class)
+            {
+                return symmetry_class.empty();
+            }), this->symmetry_classes.end());
+
+            if (!node) // already pruned
+                return;
+
+            std::pair<size_t, size_t> range = leaf_range(node);
+            prune_down(node->firstchild);
+            node->firstchild = nullptr;
+            prune_up(node);
+            this->leaves.erase(this->leaves.begin() + range.first, this->leaves.begin() + range.second);
+            check_auto_shrink();
+        }
+
+        // close the gaps left by removed alternatives, returns bin_map[old binary] = new binary (-1 if dropped)
+        std::vector<int> renumber_alternatives()
+        {
+            std::vector<int> bin_map(this->n_bins, -1);
+            if (this->alternatives.empty())
+            {
+                for (int j=0; j<this->n_bins; j++)
+                    bin_map[j] = j; // nothing to renumber against
+                return bin_map;
+            }
+
+            int n_kept = 0;
+            for (auto& alt : this->alternatives)
+            {
+                int first = alt.offset;
+                for (int j=0; j<alt.n_bins; j++)
+                    bin_map[first + j] = n_kept + j;
+                alt.offset = n_kept;
+                n_kept += alt.n_bins;
+                if (this->hcat_encoding == HcatEncoding::OneHot)
+                {
+                    bin_map[alt.indicator] = n_kept;
+                    alt.indicator = n_kept++;
+                }
+            }
+            if (this->hcat_encoding == HcatEncoding::Logarithmic)
+            {
+                int first = this->alternatives[0].indicator;
+                for (int j=first; j<this->n_bins; j++)
+                    bin_map[j] = n_kept + (j - first);
+                for (auto& alt : this->alternatives)
+                    alt.indicator = n_kept;
+                n_kept += this->n_bins - first;
+            }
+
+            renumber_helper(this->root, bin_map);
+            std::vector<PruneStats> stats(n_kept);
+            for (size_t j=0; j<this->prune_stats.size(); j++)
+            {
+                if (bin_map[j] >= 0)
+                    stats[bin_map[j]] = this->prune_stats[j];
+            }
+            this->prune_stats.swap(stats);
+            this->n_bins = n_kept;
+            update_subtree(this->root);
+            rebuild_leaves();
+            return bin_map;
+        }
+
+        // group alternatives that are identical up to their binary offset, returns the classes
+        const std::vector<std::vector<size_t>>& detect_symmetries()
+        {
+            this->symmetry_classes.clear();
+            std::unordered_map<uint64_t, std::vector<size_t>> buckets; // content hash -> classes
+            for (size_t i=0; i<this->alternatives.size(); i++)
+            {
+                const TreeNode* node = find_alternative(i);
+                if (!node)
+                    continue;
+
+                // children hashed relative to the alternative offset
+                const Alternative& alt = this->alternatives[i];
+                uint64_t hash = mix_hash(static_cast<uint64_t>(alt.n_bins));
+                for (const TreeNode* child = node->firstchild; child; child = child->nextsibling)
+                    hash += mix_hash(child->hash ^ mix_hash(static_cast<uint64_t>(child->ind - alt.offset)));
+
+                std::vector<size_t>& candidates = buckets[hash];
+                bool found = false;
+                for (size_t c : candidates)
+                {
+                    size_t j = this->symmetry_classes[c][0];
+                    if (this->alternatives[j].n_bins == alt.n_bins
+                        && equal_children(find_alternative(j), this->alternatives[j].offset, node, alt.offset))
+                    {
+                        this->symmetry_classes[c].push_back(i);
+                        found = true;
+                        break;
+                    }
+                }
+                if (!found)
+                {
+                    candidates.push_back(this->symmetry_classes.size());
+                    this->symmetry_classes.push_back({i});
+                }
+            }
+            return this->symmetry_classes;
+        }
+
+        const std::vector<std::vector<size_t>>& get_symmetry_classes() const
+        {
+            return this->symmetry_classes;
+        }
+        
+        // friend function declarations
+        friend Tree vcat(const Tree& tree1, const Tree& tree2);
+        friend Tree hcat(const std::vector<Tree>& trees, HcatEncoding encoding, bool flatten);
+        friend Tree intersect(const Tree& tree1, const Tree& tree2);
+        friend Tree unite(const Tree& tree1, const Tree& tree2);
+        friend Tree subtract(const Tree& tree1, const Tree& tree2);
+        friend std::ostream& operator<<(std::ostream& os, const Tree& tree);
+        friend bool operator==(const Tree& tree1, const Tree& tree2);
+
+        #ifdef PRUNABLE_TREE_DEBUG
+        std::vector<std::vector<std::pair<int, bool>>> get_leaf_bins_propagate() const
+        {
+            std::vector<std::vector<std::pair<int, bool>>> leaf_bins; // init
+            get_leaf_bins_propagate_helper(this->root, leaf_bins, std::vector<std::pair<int, bool>>());
+            return leaf_bins;
+        }
+
+        std::string print_propagated_leaves() const
+        {
+            std::stringstream ss;
+            std::vector<std::vector<std::pair<int, bool>>> leaf_bins = get_leaf_bins_propagate();
+            for (auto it=leaf_bins.begin(); it!=leaf_bins.end(); ++it)
+            {
+                std::sort(it->begin(), it->end(), [](const std::pair<int, bool>& a, const std::pair<int, bool>& b)
+                {
+                    return a.first < b.first;
+                });
+            }
+
+            for (const auto& leaf : leaf_bins)
+            {
+                ss << "Leaf: ";
+                for (const auto& bin : leaf)
+                {
+                    ss << "(" << bin.first << ", " << bin.second << ") ";
+                }
+                ss << std::endl;
+            }
+            return ss.str();
+        }
+        #endif        
+
+    private:
+        NodePool node_pool;
+        TreeNode* root = nullptr;
+        std::vector<std::pair<TreeNode*, std::vector<std::pair<int, bool>>>> leaves;
+        int n_bins = 0; // number of variables
+
+        // pruning statistics per binary
+        std::vector<PruneStats> prune_stats;
+        bool adaptive_order = false;
+        double auto_shrink = 0.0; // live fraction of node memory below which prunes compact the pool
+
+        // implied fixings, per node id: fixed mask followed by value mask
+        bool track_fixings = false;
+        std::vector<uint64_t> fixings;
+
+        // leaf weights, per node id: smallest and largest leaf weight in the subtree
+        bool track_weights = false;
+        std::vector<double> weights;
+
+        // preorder interval labels, per node id: enter and exit label, 0 until labelled
+        bool track_labels = false;
+        std::vector<uint64_t> preorder_labels;
+
+        // binary lifting tables for ancestor queries, per node id. Built on first query and cleared on
+        // structural changes, pruning keeps them valid since it never changes the ancestors of a kept node
+        mutable std::vector<int> lca_depth;
+        mutable std::vector<const TreeNode*> lca_up;
+        mutable int lca_log = 0;
+
+        // alternatives below the root if built by hcat, pruning keeps them valid
+        std::vector<Alternative> alternatives;
+        HcatEncoding hcat_encoding = HcatEncoding::OneHot;
+
+        // alternatives identical up to their offset, the first present one represents the class. Pruning
+        // clears them unless it is applied to the whole orbit
+        std::vector<std::vector<size_t>> symmetry_classes;
+
+        // set operations
+        enum class SetOp { Intersect, Unite, Subtract };
+
+        // node whose children hold alternative i, nullptr if it was pruned
+        TreeNode* find_alternative(size_t i) const
+        {
+            const Alternative& alt = this->alternatives[i];
+            if (this->hcat_encoding == HcatEncoding::OneHot)
+            {
+                for (TreeNode* child = this->root->firstchild; child; child = child->nextsibling)
+                {
+                    if (child->ind == alt.indicator && child->value)
+                        return child;
+                }
+                return nullptr;
+            }
+
+            // follow the bit pattern of i
+            int n_indicators = 0;
+            while ((size_t(1) << n_indicators) < this->alternatives.size())
+                ++n_indicators;
+            TreeNode* node = this->root;
+            for (int j=0; j<n_indicators && node; j++)
+            {
+                bool value = (i >> (n_indicators - 1 - j)) & 1;
+                TreeNode* child = node->firstchild;
+                while (child && !(child->ind == alt.indicator + j && child->value == value))
+                    child = child->nextsibling;
+                node = child;
+            }
+            return node;
+        }
+
+        // alternative containing node, alt_node is set to its node. Returns alternatives.size() if node is above them
+        size_t alternative_index(const TreeNode* node, const TreeNode*& alt_node) const
+        {
+            std::vector<const TreeNode*> path; // node up to the root
+            for (const TreeNode* prev = node; prev; prev = get_parent(prev))
+                path.push_back(prev);
+
+            size_t depth = 1; // of alternative nodes
+            if (this->hcat_encoding == HcatEncoding::Logarithmic)
+            {
+                depth = 0;
+                while ((size_t(1) << depth) < this->alternatives.size())
+                    ++depth;
+            }
+            if (this->alternatives.empty() || path.size() <= depth)
+                return this->alternatives.size();
+            alt_node = path[path.size() - 1 - depth];
+
+            size_t i = 0; // init
+            if (this->hcat_encoding == HcatEncoding::OneHot)
+            {
+                auto it = std::lower_bound(this->alternatives.begin(), this->alternatives.end(), alt_node->ind, [](const Alternative& alt, int ind)
+                {
+                    return alt.indicator < ind;
+                });
+                i = it - this->alternatives.begin();
+            }
+            else
+            {
+                for (size_t d=1; d<=depth; d++)
+                    i = (i << 1) | path[path.size() - 1 - d]->value;
+            }
+            if (i >= this->alternatives.size() || find_alternative(i) != alt_node)
+                return this->alternatives.size();
+            return i;
+        }
+
+        // node and its counterparts in the other alternatives of its symmetry class
+        std::vector<TreeNode*> get_orbit(TreeNode* node) const
+        {
+            const TreeNode* alt_node = nullptr;
+            size_t i = alternative_index(node, alt_node);
+            auto symmetry_class = std::find_if(this->symmetry_classes.begin(), this->symmetry_classes.end(), [&](const std::vector<size_t>& members)
+            {
+                return std::find(members.begin(), members.end(), i) != members.end();
+            });
+            if (symmetry_class == this->symmetry_classes.end())
+                return {node};
+
+            // path below the alternative node, relative to its offset
+            std::vector<const TreeNode*> path; // init
+            for (const TreeNode* prev = node; prev != alt_node; prev = get_parent(prev))
+                path.push_back(prev);
+            std::reverse(path.begin(), path.end());
+
+            std::vector<TreeNode*> orbit; // init
+            for (size_t j : *symmetry_class)
+            {
+                TreeNode* counterpart = find_alternative(j);
+                int shift = this->alternatives[j].offset - this->alternatives[i].offset;
+                for (size_t d=0; d<path.size() && counterpart; d++)
+                {
+                    TreeNode* child = counterpart->firstchild;
+                    while (child && !(child->ind == path[d]->ind + shift && child->value == path[d]->value && child->hash == path[d]->hash))
+                        child = child->nextsibling;
+                    counterpart = child;
+                }
+                if (counterpart)
+                    orbit.push_back(counterpart);
+            }
+            return orbit;
+        }
+
+        // children of node1 and node2 identical up to the offsets of their binaries
+        static bool equal_children(const TreeNode* node1, int offset1, const TreeNode* node2, int offset2)
+        {
+            std::vector<const TreeNode*> children2;
+            for (const TreeNode* child = node2->firstchild; child; child = child->nextsibling)
+                children2.push_back(child);
+            for (const TreeNode* child1 = node1->firstchild; child1; child1 = child1->nextsibling)
+            {
+                auto it = std::find_if(children2.begin(), children2.end(), [&](const TreeNode* child2)
+                {
+                    return child2->ind - offset2 == child1->ind - offset1 && equal_helper(child1, child2);
+                });
+                if (it == children2.end())
+                    return false;
+                *it = children2.back();
+                children2.pop_back();
+            }
+            return children2.empty();
+        }
+
+        void clear_alternatives()
+        {
+            this->alternatives.clear();
+            this->symmetry_classes.clear();
+        }
+
+        // shift index function
+        int shift_index(int ind, int offset)
+        {
+            return (ind < 0 ? ind : ind + offset);
+        }
+        
+        // traverse and copy
+        TreeNode* traverse_and_copy(TreeNode* copy_node, TreeNode* prev_node, const std::vector<std::pair<int, bool>>& bins, int offset=0)
+        {
+            if (!copy_node)
+            {
+                if (prev_node->ind >= 0 || prev_node->previous) // empty root without children is an empty tree
+                    this->leaves.push_back(std::make_pair(prev_node, bins)); // add to leaves
+                return nullptr;
+            }
+
+            // check for empty node
+            if (prev_node && copy_node->ind < 0)
+                return traverse_and_copy(copy_node->firstchild, prev_node, bins, offset); // skip empty node
+
+            // copy current node
+            TreeNode* new_node = node_pool.new_node(shift_index(copy_node->ind, offset), copy_node->value);
+            new_node->previous = prev_node; // set previous node
+            new_node->n_pruned = copy_node->n_pruned; // copy pruning history
+
+            // add binaries
+            std::vector<std::pair<int, bool>> bins_copy = bins; // copy
+            if (copy_node->ind >= 0) // check if non-empty
+                bins_copy.push_back(std::make_pair(new_node->ind, new_node->value)); // add current node
+
+            // recursively copy children, before the siblings so that leaves are added in preorder
+            new_node->firstchild = traverse_and_copy(copy_node->firstchild, new_node, bins_copy, offset);
+
+            // copy siblings if they exist
+            if (copy_node->nextsibling)
+                new_node->nextsibling = traverse_and_copy(copy_node->nextsibling, new_node, bins, offset);
+
+            return new_node;
+        }
+
+        // descend along the existing prefix and create the missing suffix, returns the new leaf
+        TreeNode* insert_leaf_helper(const std::vector<std::pair<int, bool>>& leaf_bins, double weight)
+        {
+            if (leaf_bins.empty())
+                throw std::invalid_argument("Leaf must assign at least one binary");
+            std::vector<signed char> assigned(this->n_bins, -1);
+            for (const auto& bin : leaf_bins)
+            {
+                if (bin.first < 0 || bin.first >= this->n_bins)
+                    throw std::out_of_range("Binary index out of range");
+                if (assigned[bin.first] >= 0)
+                    throw std::invalid_argument("Leaf assigns a binary twice");
+                assigned[bin.first] = bin.second;
+            }
+            if (contains_path(assigned))
+                return nullptr; // an existing leaf contains the assignment
+
+            // nothing below throws, the tree is only changed once the input is known to be valid
+
+            // labelled root that does not match, move it below a new empty root
+            size_t pos = 0;
+            if (this->root->ind >= 0)
+            {
+                if (this->root->ind == leaf_bins[0].first && this->root->value == leaf_bins[0].second)
+                    pos = 1;
+                else
+                {
+                    TreeNode* new_root = node_pool.new_node(-1, false);
+                    new_root->firstchild = this->root;
+                    this->root->previous = new_root;
+                    this->root = new_root;
+                    clear_label(new_root);
+                    update_node(new_root);
+                }
+            }
+
+            // existing prefix, it ends above the leaves since none of them contains the assignment
+            TreeNode* node = this->root;
+            for (; pos < leaf_bins.size(); pos++)
+            {
+                TreeNode* child = node->firstchild;
+                while (child && (child->ind != leaf_bins[pos].first || child->value != leaf_bins[pos].second))
+                    child = child->nextsibling;
+                if (!child)
+                    break;
+                node = child;
+            }
+
+            // whole assignment is a prefix, node becomes a leaf in place of the leaves below it
+            if (pos == leaf_bins.size())
+            {
+                std::vector<const TreeNode*> below;
+                get_subtree_leaves(node, below);
+                std::unordered_set<const TreeNode*> dropped(below.begin(), below.end());
+                this->leaves.erase(std::remove_if(this->leaves.begin(), this->leaves.end(), [&](const std::pair<TreeNode*, std::vector<std::pair<int, bool>>>& leaf)
+                {
+                    return dropped.count(leaf.first) > 0;
+                }), this->leaves.end());
+                prune_down(node->firstchild);
+                node->firstchild = nullptr;
+            }
+
+            // missing suffix
+            TreeNode* last = node->firstchild;
+            while (last && last->nextsibling)
+                last = last->nextsibling;
+            for (; pos < leaf_bins.size(); pos++)
+            {
+                TreeNode* new_node = node_pool.new_node(leaf_bins[pos].first, leaf_bins[pos].second);
+                append_child(node, last, new_node);
+                clear_label(new_node);
+                node = new_node;
+                last = nullptr;
+            }
+            if (weight != 0.0)
+                enable_weights();
+            if (this->track_weights)
+                set_weight(node, weight); // the id may have held another weight
+            this->leaves.push_back(std::make_pair(node, leaf_bins)); // add to leaves
+            return node;
+        }
+
+        // check if some leaf lies on a path that only tests assigned binaries with their values, the
+        // assignment is then contained whatever order its binaries are given in
+        bool contains_path(const std::vector<signed char>& assigned) const
+        {
+            std::vector<const TreeNode*> stack = {this->root};
+            while (!stack.empty())
+            {
+                const TreeNode* node = stack.back();
+                stack.pop_back();
+                if (node->ind >= 0 && assigned[node->ind] != node->value)
+                    continue; // untested or conflicting binary
+                if (!node->firstchild)
+                {
+                    if (node->ind >= 0) // empty root is not a leaf
+                        return true;
+                    continue;
+                }
+                for (const TreeNode* child = node->firstchild; child; child = child->nextsibling)
+                    stack.push_back(child);
+            }
+            return false;
+        }
+
+        // tree pruning helpers, nodes must be disjoint subtrees
+        void prune_nodes(const std::vector<TreeNode*>& nodes)
+        {
+            for (TreeNode* node : nodes)
+                prune_subtree(node);
+            check_auto_shrink();
+        }
+
+        // largest subtrees whose leaves lie in [begin, end), offset is the index of the first leaf below node
+        void cover_leaf_range(TreeNode* node, size_t offset, size_t begin, size_t end, std::vector<TreeNode*>& nodes)
+        {
+            if (offset >= begin && offset + node->n_leaves <= end)
+            {
+                nodes.push_back(node);
+                return;
+            }
+            for (TreeNode* child = node->firstchild; child && offset < end; child = child->nextsibling)
+            {
+                if (offset + child->n_leaves > begin)
+                    cover_leaf_range(child, offset, begin, end, nodes);
+                offset += child->n_leaves;
+            }
+        }
+
+        // number of leaves before node in preorder
+        static size_t leaves_before(const TreeNode* node)
+        {
+            size_t k = 0;
+            while (node->previous)
+            {
+                const TreeNode* prev = node->previous;
+                if (prev->firstchild != node)
+                    k += prev->n_leaves; // previous sibling
+                node = prev;
+            }
+            return k;
+        }
+
+        // move the leaf added last to its preorder position, the summaries of its siblings must be current
+        void place_new_leaf(const TreeNode* leaf)
+        {
+            size_t pos = leaves_before(leaf);
+            std::rotate(this->leaves.begin() + pos, this->leaves.end() - 1, this->leaves.end());
+        }
+
+        // put the leaf slice of node back in preorder after its children were reordered
+        void order_leaf_slice(const TreeNode* node, const std::pair<size_t, size_t>& range)
+        {
+            std::vector<const TreeNode*> leaf_nodes;
+            get_subtree_leaves(node, leaf_nodes);
+            std::unordered_map<const TreeNode*, size_t> slot; // leaf -> old index
+            for (size_t i=range.first; i<range.second; i++)
+                slot[this->leaves[i].first] = i;
+
+            std::vector<std::pair<TreeNode*, std::vector<std::pair<int, bool>>>> slice;
+            slice.reserve(range.second - range.first);
+            for (const TreeNode* leaf : leaf_nodes)
+                slice.push_back(std::move(this->leaves[slot[leaf]]));
+            std::move(slice.begin(), slice.end(), this->leaves.begin() + range.first);
+        }
+
+        // compact the node pool if too little of it is live
+        void check_auto_shrink()
+        {
+            if (this->auto_shrink <= 0.0 || this->node_pool.n_chunks() < 2)
+                return; // nothing to give back
+            double live = static_cast<double>(this->node_pool.size() * sizeof(TreeNode)) / this->node_pool.bytes_reserved();
+            if (live < this->auto_shrink)
+                shrink_to_fit();
+        }
+
+        // copy node and its subtree into pool in preorder, with all annotations
+        TreeNode* compact_helper(const TreeNode* node, NodePool& pool, std::vector<uint64_t>& fixings, std::vector<double>& weights,
+            std::vector<TreeNode*>& new_leaves) const
+        {
+            TreeNode* copy = pool.new_node(node->ind, node->value);
+            uint32_t id = copy->id;
+            *copy = *node;
+            copy->id = id;
+            copy->firstchild = nullptr;
+            copy->nextsibling = nullptr;
+            copy->previous = nullptr;
+            if (this->track_fixings)
+            {
+                size_t stride = 2 * fixings_words();
+                std::copy(fixed_mask(node), fixed_mask(node) + stride, fixings.data() + id * stride);
+            }
+            if (this->track_weights)
+            {
+                weights[2 * id] = min_weight(node);
+                weights[2 * id + 1] = max_weight(node);
+            }
+            if (!node->firstchild && (node != this->root || node->ind >= 0)) // empty root is not a leaf
+                new_leaves.push_back(copy);
+
+            TreeNode* last = nullptr;
+            for (const TreeNode* child = node->firstchild; child; child = child->nextsibling)
+                append_child(copy, last, compact_helper(child, pool, fixings, weights, new_leaves));
+            return copy;
+        }
+
+        // prune node and its subtree, its leaf slice is erased right away so that sifting can move the slices
+        // of the kept ancestors
+        void prune_subtree(TreeNode* node)
+        {
+            size_t n_nodes = this->node_pool.size();
+            size_t n_leaves = node->n_leaves;
+            std::pair<size_t, size_t> range = leaf_range(node);
+
+            // binaries tested on the path, node included
+            std::vector<int> path_bins;
+            for (const TreeNode* prev = node; prev; prev = get_parent(prev))
+            {
+                if (prev->ind >= 0)
+                    path_bins.push_back(prev->ind);
+            }
+
+            // surviving ancestors, the last one with another child is found by prune_up
+            TreeNode* survivor = get_parent(node);
+            while (survivor && survivor != this->root && !survivor->firstchild->nextsibling)
+                survivor = get_parent(survivor);
+
+            prune_down(node->firstchild); // delete children
+            node->firstchild = nullptr;
+            prune_up(node); // delete node
+            this->leaves.erase(this->leaves.begin() + range.first, this->leaves.begin() + range.second);
+
+            record_prune(path_bins, n_nodes - this->node_pool.size(), n_leaves);
+            this->symmetry_classes.clear(); // alternatives may differ now
+
+            // count the prune on kept ancestors and move them back among their siblings
+            for (TreeNode* prev = survivor; prev; prev = get_parent(prev))
+            {
+                ++prev->n_pruned;
+                if (this->adaptive_order)
+                    sift_back(prev);
+            }
+        }
+
+        // children with fewer prunes below them first, then by smallest leaf weight
+        bool prune_order_less(const TreeNode* a, const TreeNode* b) const
+        {
+            return (a->n_pruned < b->n_pruned) || (a->n_pruned == b->n_pruned && min_weight(a) < min_weight(b));
+        }
+
+        // move node towards the end of its siblings while a later sibling should come first, the leaf slice
+        // of node is rotated past the slice of each sibling it passes
+        void sift_back(TreeNode* node)
+        {
+            while (node->nextsibling && prune_order_less(node->nextsibling, node))
+            {
+                TreeNode* next = node->nextsibling;
+                auto first = this->leaves.begin() + leaves_before(node);
+                std::rotate(first, first + node->n_leaves, first + node->n_leaves + next->n_leaves);
+
+                // swap node with its next sibling
+                TreeNode* prev = node->previous;
+                if (prev->firstchild == node)
+                    prev->firstchild = next;
+                else
+                    prev->nextsibling = next;
+                next->previous = prev;
+                node->nextsibling = next->nextsibling;
+                if (next->nextsibling)
+                    next->nextsibling->previous = node;
+                next->nextsibling = node;
+                node->previous = next;
+            }
+        }
+
+        void record_prune(const std::vector<int>& path_bins, size_t nodes_removed, size_t leaves_removed)
+        {
+            for (int ind : path_bins)
+            {
+                PruneStats& stats = this->prune_stats[ind];
+                ++stats.n_prunes;
+                stats.nodes_removed += nodes_removed;
+                stats.leaves_removed += leaves_removed;
+                stats.avg_nodes_removed += (nodes_removed - stats.avg_nodes_removed) / stats.n_prunes;
+                stats.avg_leaves_removed += (leaves_removed - stats.avg_leaves_removed) / stats.n_prunes;
+            }
+        }
+
+        void prune_up(TreeNode* node)
+        {
+            // do not prune if node is null or has children
+            if (!node || node->firstchild) return;
+
+            // keep root, tree is empty
+            if (node == this->root)
+            {
+                node->ind = -1;
+                node->value = false;
+                update_node(node);
+                return;
+            }
+
+            // upstream node
+            TreeNode* prev = node->previous;
+            TreeNode* parent = prev;
+
+            if (node->nextsibling)
+                node->nextsibling->previous = prev; // update sibling connectivity
+
+            if (prev->firstchild == node)
+            {
+                // update parent connectivity
+                prev->firstchild = node->nextsibling;
+                
+                // recurse if able
+                if (!prev->firstchild)
+                {
+                    this->node_pool.delete_node(node);
+                    prune_up(prev);
+                    return;
+                }
+            }
+            else
+            {
+                // update sibling connectivity
+                prev->nextsibling = node->nextsibling;
+                parent = get_parent(prev);
+            }
+
+            // delete node
+            this->node_pool.delete_node(node);
+
+            // update summaries of remaining ancestors
+            update_path(parent);
+        }
+
+        void prune_down(TreeNode* node)
+        {
+            if (!node) return;
+
+            TreeNode* child = node->firstchild;
+            TreeNode* sibling = node->nextsibling;
+
+            prune_down(child); // recurse down
+            prune_down(sibling); // recurse across
+            this->node_pool.delete_node(node); // delete node
+        }
+
+        // parent of node, walking back along the siblings
+        static TreeNode* get_parent(const TreeNode* node)
+        {
+            TreeNode* prev = node->previous;
+            while (prev && prev->firstchild != node)
+            {
+                node = prev;
+                prev = prev->previous;
+            }
+            return prev;
+        }
+
+        // leaf nodes in subtree
+        void get_subtree_leaves(const TreeNode* node, std::vector<const TreeNode*>& subtree_leaves) const
+        {
+            if (!node->firstchild)
+            {
+                subtree_leaves.push_back(node);
+                return;
+            }
+            for (const TreeNode* child = node->firstchild; child; child = child->nextsibling)
+                get_subtree_leaves(child, subtree_leaves);
+        }
+
+        // rebuild leaves from the tree structure
+        void rebuild_leaves()
+        {
+            this->leaves.clear();
+            std::vector<std::pair<int, bool>> bins; // init
+            rebuild_leaves_helper(this->root, bins);
+        }
+
+        void rebuild_leaves_helper(TreeNode* node, std::vector<std::pair<int, bool>>& bins)
+        {
+            if (node->ind >= 0) // check if non-empty
+                bins.push_back(std::make_pair(node->ind, node->value));
+
+            if (!node->firstchild)
+            {
+                if (node != this->root || node->ind >= 0) // empty root is not a leaf
+                    this->leaves.push_back(std::make_pair(node, bins));
+            }
+            for (TreeNode* child = node->firstchild; child; child = child->nextsibling)
+                rebuild_leaves_helper(child, bins);
+
+            if (node->ind >= 0)
+                bins.pop_back();
+        }
+
+        // node summaries
+        static uint64_t mix_hash(uint64_t x)
+        {
+            // splitmix64 finalizer
+            x += 0x9e3779b97f4a7c15ULL;
+            x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+            x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+            return x ^ (x >> 31);
+        }
+
+        // recompute summaries of node from its children
+        void update_node(TreeNode* node)
+        {
+            update_summary(node);
+            if (this->track_fixings)
+                update_fixings(node);
+            if (this->track_weights)
+                update_weights(node);
+        }
+
+        // hash and leaf count
+        void update_summary(TreeNode* node)
+        {
+            // label term, children are hashed relative to the node index so subtrees hash equal after offsetting
+            uint64_t hash = (node->ind < 0) ? 0x2545f4914f6cdd1dULL : (node->value ? 0x6a09e667f3bcc909ULL : 0xbb67ae8584caa73bULL);
+            size_t n_leaves = 0;
+            for (const TreeNode* child = node->firstchild; child; child = child->nextsibling)
+            {
+                hash += mix_hash(child->hash ^ mix_hash(static_cast<uint64_t>(child->ind - node->ind)));
+                n_leaves += child->n_leaves;
+            }
+            node->hash = hash;
+
+            if (!node->firstchild)
+                n_leaves = (node != this->root || node->ind >= 0) ? 1 : 0; // empty root is not a leaf
+            node->n_leaves = n_leaves;
+        }
+
+        // update summaries from node up to the root
+        void update_path(TreeNode* node)
+        {
+            while (node)
+            {
+                update_node(node);
+                node = get_parent(node);
+            }
+        }
+
+        // update summaries of all nodes in subtree
+        void update_subtree(TreeNode* node)
+        {
+            this->lca_depth.clear(); // structure changed
+
+
+            // fixings of the path above node
+            std::vector<uint64_t> path, path_values;
+            if (this->track_fixings)
+            {
+                reserve_fixings();
+                path.assign(fixings_words(), 0);
+                path_values.assign(fixings_words(), 0);
+                for (const TreeNode* prev = get_parent(node); prev; prev = get_parent(prev))
+                    set_bin(path.data(), path_values.data(), prev);
+            }
+            update_subtree_helper(node, path, path_values);
+            if (this->track_labels)
+                label_subtree(node);
+        }
+
+        // state of one membership lookup, node is the next node to test
+        struct LookupCursor
+        {
+            const TreeNode* node;
+            const std::vector<bool>* assignment;
+            size_t query; // index of the assignment
+        };
+
+        static constexpr size_t lookup_window = 16; // lookups in flight
+
+        const TreeNode* first_lookup_node() const
+        {
+            return (this->root->ind < 0) ? this->root->firstchild : this->root;
+        }
+
+        static void prefetch_node(const TreeNode* node)
+        {
+            #if defined(__GNUC__)
+            __builtin_prefetch(node);
+            #endif
+        }
+
+        // test one node, returns true when the lookup is done with node set to the leaf found or nullptr
+        static bool lookup_step(LookupCursor& cursor)
+        {
+            const TreeNode* node = cursor.node;
+            if ((*cursor.assignment)[node->ind] == node->value)
+            {
+                if (!node->firstchild)
+                    return true; // leaf contains the assignment
+                cursor.node = node->firstchild;
+            }
+            else
+            {
+                // next sibling, climbing out of subtrees without a match
+                while (!node->nextsibling)
+                {
+                    node = get_parent(node);
+                    if (!node || node->ind < 0)
+                    {
+                        cursor.node = nullptr;
+                        return true;
+                    }
+                }
+                cursor.node = node->nextsibling;
+            }
+            prefetch_node(cursor.node);
+            return false;
+        }
+
+        // preorder labels, spaced so that new branches usually fit between existing labels
+        static constexpr uint64_t label_gap = uint64_t(1) << 16;
+
+        uint64_t* preorder_label(const TreeNode* node)
+        {
+            return this->preorder_labels.data() + 2 * node->id;
+        }
+
+        const uint64_t* preorder_label(const TreeNode* node) const
+        {
+            return this->preorder_labels.data() + 2 * node->id;
+        }
+
+        void reserve_labels()
+        {
+            size_t size = 2 * this->node_pool.id_bound();
+            if (this->preorder_labels.size() < size)
+                this->preorder_labels.resize(std::max(size, 2 * this->preorder_labels.size()), 0);
+        }
+
+        // mark a new node as unlabelled, its id may have been labelled before
+        void clear_label(const TreeNode* node)
+        {
+            if (!this->track_labels)
+                return;
+            reserve_labels();
+            preorder_label(node)[0] = 0;
+            preorder_label(node)[1] = 0;
+        }
+
+        void label_tree()
+        {
+            reserve_labels();
+            uint64_t label = label_gap;
+            label_helper(this->root, label, label_gap);
+        }
+
+        void label_helper(const TreeNode* node, uint64_t& label, uint64_t step)
+        {
+            preorder_label(node)[0] = label;
+            label += step;
+            for (const TreeNode* child = node->firstchild; child; child = child->nextsibling)
+                label_helper(child, label, step);
+            preorder_label(node)[1] = label;
+            label += step;
+        }
+
+        // label subtree between the labels of its neighbours, relabel the whole tree if it does not fit
+        void label_subtree(TreeNode* node)
+        {
+            reserve_labels();
+            TreeNode* parent = get_parent(node);
+            if (!parent || preorder_label(parent)[1] == 0 || (node->nextsibling && preorder_label(node->nextsibling)[1] == 0))
+            {
+                label_tree();
+                return;
+            }
+            uint64_t lo = (node->previous == parent) ? preorder_label(parent)[0] : preorder_label(node->previous)[1];
+            uint64_t hi = node->nextsibling ? preorder_label(node->nextsibling)[0] : preorder_label(parent)[1];
+
+            size_t n_nodes = 0;
+            std::vector<const TreeNode*> stack = {node};
+            while (!stack.empty())
+            {
+                const TreeNode* top = stack.back();
+                stack.pop_back();
+                ++n_nodes;
+                for (const TreeNode* child = top->firstchild; child; child = child->nextsibling)
+                    stack.push_back(child);
+            }
+
+            uint64_t step = (hi > lo) ? (hi - lo) / (2 * n_nodes + 1) : 0;
+            if (step == 0)
+            {
+                label_tree(); // gap exhausted
+                return;
+            }
+            uint64_t label = lo + step;
+            label_helper(node, label, step);
+        }
+
+        // label the unlabelled nodes above a newly inserted leaf
+        void label_new_branch(TreeNode* leaf)
+        {
+            TreeNode* top = leaf;
+            for (TreeNode* parent = get_parent(top); parent && preorder_label(parent)[1] == 0; parent = get_parent(top))
+                top = parent;
+            label_subtree(top);
+        }
+
+        void update_subtree_helper(TreeNode* node, std::vector<uint64_t>& path, std::vector<uint64_t>& path_values)
+        {
+            if (!this->track_fixings)
+            {
+                for (TreeNode* child = node->firstchild; child; child = child->nextsibling)
+                    update_subtree_helper(child, path, path_values);
+                update_node(node);
+                return;
+            }
+
+            // add node to path
+            size_t word = (node->ind < 0) ? 0 : node->ind / 64;
+            uint64_t old_fixed = 0, old_value = 0;
+            if (node->ind >= 0)
+            {
+                old_fixed = path[word];
+                old_value = path_values[word];
+                set_bin(path.data(), path_values.data(), node);
+            }
+
+            if (!node->firstchild)
+            {
+                // leaf, fixings are the path
+                uint64_t* fixed = fixed_mask(node);
+                std::copy(path.begin(), path.end(), fixed);
+                std::copy(path_values.begin(), path_values.end(), fixed + fixings_words());
+                update_summary(node);
+                if (this->track_weights)
+                    update_weights(node);
+            }
+            else
+            {
+                for (TreeNode* child = node->firstchild; child; child = child->nextsibling)
+                    update_subtree_helper(child, path, path_values);
+                update_node(node);
+            }
+
+            // remove node from path
+            if (node->ind >= 0)
+            {
+                path[word] = old_fixed;
+                path_values[word] = old_value;
+            }
+        }
+
+        // binary lifting tables
+        void build_lca_index() const
+        {
+            if (!this->lca_depth.empty())
+                return;
+
+            // depths and parents
+            this->lca_depth.assign(this->node_pool.id_bound(), 0);
+            std::vector<const TreeNode*> parents(this->node_pool.id_bound(), nullptr);
+            int max_depth = 0;
+            std::vector<const TreeNode*> stack = {this->root};
+            while (!stack.empty())
+            {
+                const TreeNode* node = stack.back();
+                stack.pop_back();
+                for (const TreeNode* child = node->firstchild; child; child = child->nextsibling)
+                {
+                    this->lca_depth[child->id] = this->lca_depth[node->id] + 1;
+                    max_depth = std::max(max_depth, this->lca_depth[child->id]);
+                    parents[child->id] = node;
+                    stack.push_back(child);
+                }
+            }
+
+            // ancestors at powers of two, the root is its own ancestor
+            this->lca_log = 1;
+            while ((1 << this->lca_log) <= max_depth)
+                ++this->lca_log;
+            this->lca_up.assign(this->node_pool.id_bound() * this->lca_log, this->root);
+            stack = {this->root};
+            while (!stack.empty())
+            {
+                const TreeNode* node = stack.back();
+                stack.pop_back();
+                if (parents[node->id])
+                {
+                    const TreeNode** up = &this->lca_up[node->id * this->lca_log];
+                    up[0] = parents[node->id];
+                    for (int k=1; k<this->lca_log; k++)
+                        up[k] = this->lca_up[up[k-1]->id * this->lca_log + k-1];
+                }
+                for (const TreeNode* child = node->firstchild; child; child = child->nextsibling)
+                    stack.push_back(child);
+            }
+        }
+
+        // implied fixings helpers
+        size_t fixings_words() const
+        {
+            return (this->n_bins + 63) / 64;
+        }
+
+        uint64_t* fixed_mask(const TreeNode* node)
+        {
+            return this->fixings.data() + node->id * 2 * fixings_words();
+        }
+
+        const uint64_t* fixed_mask(const TreeNode* node) const
+        {
+            return this->fixings.data() + node->id * 2 * fixings_words();
+        }
+
+        void reserve_fixings()
+        {
+            size_t size = this->node_pool.id_bound() * 2 * fixings_words();
+            if (this->fixings.size() < size)
+                this->fixings.resize(std::max(size, 2 * this->fixings.size()));
+        }
+
+        static void set_bin(uint64_t* fixed, uint64_t* values, const TreeNode* node)
+        {
+            if (node->ind < 0) return;
+            uint64_t bit = uint64_t(1) << (node->ind % 64);
+            fixed[node->ind / 64] |= bit;
+            if (node->value)
+                values[node->ind / 64] |= bit;
+            else
+                values[node->ind / 64] &= ~bit;
+        }
+
+        // fixings of node are the binaries that agree in all children
+        void update_fixings(TreeNode* node)
+        {
+            reserve_fixings();
+            size_t words = fixings_words();
+            uint64_t* fixed = fixed_mask(node);
+            uint64_t* values = fixed + words;
+
+            if (!node->firstchild)
+            {
+                // leaf, fixings are the path
+                std::fill(fixed, fixed + 2*words, 0);
+                for (const TreeNode* prev = node; prev; prev = get_parent(prev))
+                    set_bin(fixed, values, prev);
+                return;
+            }
+
+            const uint64_t* first = fixed_mask(node->firstchild);
+            std::copy(first, first + 2*words, fixed);
+            for (const TreeNode* child = node->firstchild->nextsibling; child; child = child->nextsibling)
+            {
+                const uint64_t* child_fixed = fixed_mask(child);
+                const uint64_t* child_values = child_fixed + words;
+                for (size_t w=0; w<words; w++)
+                    fixed[w] &= child_fixed[w] & ~(values[w] ^ child_values[w]);
+            }
+            for (size_t w=0; w<words; w++)
+                values[w] &= fixed[w];
+        }
+
+        // leaf weight helpers, every weight is 0 while weights are not tracked
+        double min_weight(const TreeNode* node) const
+        {
+            return this->track_weights ? this->weights[2 * node->id] : 0.0;
+        }
+
+        double max_weight(const TreeNode* node) const
+        {
+            return this->track_weights ? this->weights[2 * node->id + 1] : 0.0;
+        }
+
+        void enable_weights()
+        {
+            if (this->track_weights)
+                return;
+            this->track_weights = true;
+            this->weights.assign(2 * this->node_pool.id_bound(), 0.0);
+        }
+
+        void reserve_weights()
+        {
+            size_t size = 2 * this->node_pool.id_bound();
+            if (this->weights.size() < size)
+                this->weights.resize(std::max(size, 2 * this->weights.size()), 0.0);
+        }
+
+        void set_weight(const TreeNode* leaf, double weight)
+        {
+            reserve_weights();
+            this->weights[2 * leaf->id] = weight;
+            this->weights[2 * leaf->id + 1] = weight;
+        }
+
+        // weight range of node from its children, a leaf keeps its own weight
+        void update_weights(TreeNode* node)
+        {
+            reserve_weights();
+            double* range = this->weights.data() + 2 * node->id;
+            if (!node->firstchild)
+            {
+                range[1] = range[0];
+                return;
+            }
+            range[0] = min_weight(node->firstchild);
+            range[1] = max_weight(node->firstchild);
+            for (const TreeNode* child = node->firstchild->nextsibling; child; child = child->nextsibling)
+            {
+                range[0] = std::min(range[0], min_weight(child));
+                range[1] = std::max(range[1], max_weight(child));
+            }
+        }
+
+        // weights of the leaves of other, which match the leaves of this tree in preorder
+        void copy_leaf_weights(const Tree& other)
+        {
+            if (!other.track_weights)
+                return;
+            enable_weights();
+            for (size_t i=0; i<this->leaves.size(); i++)
+                set_weight(this->leaves[i].first, other.min_weight(other.leaves[i].first));
+        }
+
+        // structural comparison up to an index offset
+        static bool equal_helper(const TreeNode* node1, const TreeNode* node2)
+        {
+            if (node1->hash != node2->hash || node1->value != node2->value || (node1->ind < 0) != (node2->ind < 0))
+                return false;
+
+            // match children as a multiset
+            std::vector<const TreeNode*> children2;
+            for (const TreeNode* child = node2->firstchild; child; child = child->nextsibling)
+                children2.push_back(child);
+            for (const TreeNode* child1 = node1->firstchild; child1; child1 = child1->nextsibling)
+            {
+                auto it = std::find_if(children2.begin(), children2.end(), [&](const TreeNode* child2)
+                {
+                    return child2->ind - node2->ind == child1->ind - node1->ind && equal_helper(child1, child2);
+                });
+                if (it == children2.end())
+                    return false;
+                *it = children2.back();
+                children2.pop_back();
+            }
+            return children2.empty();
+        }
+
+        // merge the projection of the subtree below node into out
+        void project_helper(const TreeNode* node, TreeNode* out, const std::vector<bool>& keep, std::vector<bool>& full)
+        {
+            if (out->id < full.size() && full[out->id])
+                return; // already contains every continuation
+
+            // leaf, out contains every continuation
+            if (!node->firstchild)
+            {
+                prune_down(out->firstchild); // ids of the deleted nodes are reused below
+                out->firstchild = nullptr;
+                if (full.size() <= out->id)
+                    full.resize(this->node_pool.id_bound(), false);
+                full[out->id] = true;
+                return;
+            }
+
+            for (const TreeNode* child = node->firstchild; child; child = child->nextsibling)
+            {
+                if (!keep[child->ind])
+                {
+                    project_helper(child, out, keep, full); // drop node, merge its children into out
+                    if (out->id < full.size() && full[out->id])
+                        return;
+                    continue;
+                }
+
+                // find or create child of out with the same label
+                TreeNode* last = nullptr;
+                TreeNode* target = out->firstchild;
+                while (target && (target->ind != child->ind || target->value != child->value))
+                {
+                    last = target;
+                    target = target->nextsibling;
+                }
+                if (!target)
+                {
+                    target = node_pool.new_node(child->ind, child->value);
+                    append_child(out, last, target);
+                    if (target->id < full.size())
+                        full[target->id] = false; // id of a deleted node
+                }
+                project_helper(child, target, keep, full);
+            }
+        }
+
+        // count leaves below node, skipping branches that conflict with the assignment
+        static size_t count_helper(const TreeNode* node, const std::vector<signed char>& assigned, int n_remaining)
+        {
+            if (node->ind >= 0 && assigned[node->ind] >= 0)
+            {
+                if (assigned[node->ind] != node->value)
+                    return 0; // conflict
+                --n_remaining;
+            }
+            if (n_remaining == 0)
+                return node->n_leaves; // every leaf below matches
+            if (!node->firstchild)
+                return 0; // path ends before testing every assigned binary
+
+            size_t n = 0;
+            for (const TreeNode* child = node->firstchild; child; child = child->nextsibling)
+                n += count_helper(child, assigned, n_remaining);
+            return n;
+        }
+
+        // presolve helpers
+        static void mark_used_bins(const TreeNode* node, std::vector<bool>& used)
+        {
+            if (node->ind >= 0)
+                used[node->ind] = true;
+            for (const TreeNode* child = node->firstchild; child; child = child->nextsibling)
+                mark_used_bins(child, used);
+        }
+
+        static void renumber_helper(TreeNode* node, const std::vector<int>& bin_map)
+        {
+            if (node->ind >= 0)
+                node->ind = bin_map[node->ind];
+            for (TreeNode* child = node->firstchild; child; child = child->nextsibling)
+                renumber_helper(child, bin_map);
+        }
 
-            // add binaries
-            std::vector<std::pair<int, bool>> bins_copy = bins; // copy
-            if (copy_node->ind >= 0) // check if non-empty
-                bins_copy.push_back(std::make_pair(new_node->ind, new_node->value)); // add current node
+        // splice the children of fixed nodes into their parents
+        void presolve_helper(TreeNode* node, const std::vector<bool>& fixed)
+        {
+            TreeNode* child = node->firstchild;
+            TreeNode* last = nullptr;
+            node->firstchild = nullptr;
+            while (child)
+            {
+                TreeNode* next = child->nextsibling;
+                child->nextsibling = nullptr;
+                presolve_helper(child, fixed);
 
-            // recursively copy children
-            new_node->firstchild = traverse_and_copy(copy_node->firstchild, new_node, bins_copy, offset);
+                if (!fixed[child->ind])
+                {
+                    append_child(node, last, child);
+                    child = next;
+                    continue;
+                }
 
-            return new_node;
+                if (!child->firstchild)
+                {
+                    // fixed leaf, node contains every continuation
+                    this->node_pool.delete_node(child);
+                    prune_down(node->firstchild);
+                    prune_down(next);
+                    node->firstchild = nullptr;
+                    return;
+                }
+
+                // move grandchildren up
+                TreeNode* grandchild = child->firstchild;
+                while (grandchild)
+                {
+                    TreeNode* next_grandchild = grandchild->nextsibling;
+                    grandchild->nextsibling = nullptr;
+                    append_child(node, last, grandchild);
+                    grandchild = next_grandchild;
+                }
+                this->node_pool.delete_node(child);
+                child = next;
+            }
         }
 
-        // tree pruning helpers
-        void prune_up(TreeNode* node)
+        // sort children by label, siblings must already be reduced
+        void canonicalize_helper(TreeNode* node)
         {
-            // do not prune if node is null or has children
-            if (!node || node->firstchild) return;
+            if (!node->firstchild) return;
 
-            // upstream node
-            TreeNode* prev = node->previous;
+            std::vector<TreeNode*> children;
+            for (TreeNode* child = node->firstchild; child; child = child->nextsibling)
+                children.push_back(child);
+            std::sort(children.begin(), children.end(), label_less);
 
-            if (prev && prev->firstchild == node)
-            {
-                // update parent connectivity
-                prev->firstchild = node->nextsibling;
-                
-                // recurse if able
-                if (!prev->firstchild)
-                    prune_up(prev);
-            }
-            else
+            // relink in sorted order
+            TreeNode* last = nullptr;
+            node->firstchild = nullptr;
+            for (TreeNode* child : children)
             {
-                // update sibling connectivity
-                prev->nextsibling = node->nextsibling;
+                child->nextsibling = nullptr;
+                append_child(node, last, child);
             }
 
-            // delete node
-            this->node_pool.delete_node(node);
+            for (TreeNode* child = node->firstchild; child; child = child->nextsibling)
+                canonicalize_helper(child);
         }
 
-        void prune_down(TreeNode* node)
+        // merge children with equal labels, then recurse. Hashes of untouched siblings are still
+        // valid at this point, so identical duplicates are dropped without merging their subtrees
+        void reduce_helper(TreeNode* node, std::unordered_map<uint64_t, std::pair<TreeNode*, bool>>& labels)
         {
-            if (!node) return;
+            if (!node->firstchild) return;
 
+            labels.clear();
             TreeNode* child = node->firstchild;
-            TreeNode* sibling = node->nextsibling;
+            while (child)
+            {
+                TreeNode* next = child->nextsibling;
+                uint64_t key = (static_cast<uint64_t>(static_cast<uint32_t>(child->ind)) << 1) | child->value;
+                auto it = labels.find(key);
+                if (it == labels.end())
+                {
+                    labels.emplace(key, std::make_pair(child, true)); // first with this label, hash still valid
+                    child = next;
+                    continue;
+                }
 
-            prune_down(child); // recurse down
-            prune_down(sibling); // recurse across
+                // unlink duplicate
+                child->previous->nextsibling = next;
+                if (next)
+                    next->previous = child->previous;
+                child->nextsibling = nullptr;
+
+                TreeNode* keep = it->second.first;
+                if (it->second.second && equal_helper(keep, child))
+                {
+                    prune_down(child->firstchild); // identical subtree
+                    this->node_pool.delete_node(child);
+                }
+                else
+                {
+                    merge_siblings(keep, child);
+                    it->second.second = false; // merged, hash is stale
+                }
+                child = next;
+            }
+
+            for (child = node->firstchild; child; child = child->nextsibling)
+                reduce_helper(child, labels);
+        }
+
+        // merge the subtree of dup into node and delete dup, a leaf absorbs the other subtree
+        void merge_siblings(TreeNode* node, TreeNode* dup)
+        {
+            if (!node->firstchild || !dup->firstchild)
+            {
+                prune_down(node->firstchild);
+                prune_down(dup->firstchild);
+                node->firstchild = nullptr;
+            }
+            else
+            {
+                TreeNode* last = node->firstchild;
+                while (last->nextsibling)
+                    last = last->nextsibling;
+                last->nextsibling = dup->firstchild;
+                dup->firstchild->previous = last;
+            }
+            this->node_pool.delete_node(dup);
         }
 
         // helper for branch info method
@@ -348,8 +2991,207 @@ class Tree
             return children_info;
         }
 
+        // distinct prefixes after extending prefix ids 0..n_prefixes-1 by column, seen is scratch
+        static size_t count_extended(const std::vector<bool>& column, const std::vector<uint32_t>& prefix, size_t n_prefixes,
+            std::vector<unsigned char>& seen)
+        {
+            seen.assign(n_prefixes, 0);
+            size_t count = 0;
+            for (size_t i=0; i<prefix.size(); i++)
+            {
+                unsigned char bit = column[i] ? 2 : 1;
+                if (!(seen[prefix[i]] & bit))
+                {
+                    seen[prefix[i]] |= bit;
+                    ++count;
+                }
+            }
+            return count;
+        }
+
+        // extend prefix ids in place by column, returns new number of prefixes, ids is scratch
+        static size_t extend_prefixes(const std::vector<bool>& column, std::vector<uint32_t>& prefix, size_t n_prefixes,
+            std::vector<uint32_t>& ids)
+        {
+            ids.assign(2 * n_prefixes, UINT32_MAX);
+            uint32_t count = 0;
+            for (size_t i=0; i<prefix.size(); i++)
+            {
+                uint32_t& id = ids[2 * prefix[i] + column[i]];
+                if (id == UINT32_MAX)
+                    id = count++;
+                prefix[i] = id;
+            }
+            return count;
+        }
+
+        // number of nodes below the root when branching in the given order, columns[bin][leaf]
+        static size_t count_prefixes(const std::vector<std::vector<bool>>& columns, const std::vector<int>& order, size_t limit = SIZE_MAX)
+        {
+            if (columns.empty() || columns[0].empty())
+                return 0;
+
+            std::vector<uint32_t> prefix(columns[0].size(), 0); // prefix id of each leaf
+            std::vector<uint32_t> ids;
+            size_t n_prefixes = 1;
+            size_t count = 0;
+            for (int bin : order)
+            {
+                n_prefixes = extend_prefixes(columns[bin], prefix, n_prefixes, ids);
+                count += n_prefixes;
+                if (count >= limit)
+                    return count; // no improvement possible
+            }
+            return count;
+        }
+
+        // greedy static order, pick the binary giving the fewest distinct prefixes at each level. Prefix ids of
+        // the chosen order are kept, so each candidate costs one column scan. Once the budget cannot cover a
+        // level the remaining binaries follow in index order
+        static std::vector<int> greedy_order(const std::vector<std::vector<bool>>& columns, size_t& budget)
+        {
+            std::vector<int> order; // init
+            std::vector<int> remaining(columns.size());
+            for (size_t i=0; i<columns.size(); i++)
+                remaining[i] = static_cast<int>(i);
+            if (columns.empty() || columns[0].empty())
+                return remaining;
+
+            std::vector<uint32_t> prefix(columns[0].size(), 0); // prefix id of each leaf
+            std::vector<uint32_t> ids;
+            std::vector<unsigned char> seen;
+            size_t n_prefixes = 1;
+            while (!remaining.empty())
+            {
+                if (budget < remaining.size())
+                    break;
+                budget -= remaining.size();
+
+                size_t best_ind = 0;
+                size_t best_count = SIZE_MAX;
+                for (size_t i=0; i<remaining.size(); i++)
+                {
+                    size_t count = count_extended(columns[remaining[i]], prefix, n_prefixes, seen);
+                    if (count < best_count)
+                    {
+                        best_count = count;
+                        best_ind = i;
+                    }
+                }
+                n_prefixes = extend_prefixes(columns[remaining[best_ind]], prefix, n_prefixes, ids);
+                order.push_back(remaining[best_ind]);
+                remaining.erase(remaining.begin() + best_ind);
+            }
+            order.insert(order.end(), remaining.begin(), remaining.end());
+            return order;
+        }
+
+        // move each binary through all levels and keep its best level, a trial is charged one column scan per
+        // level and sifting stops once the budget cannot cover one
+        static void sift_order(const std::vector<std::vector<bool>>& columns, std::vector<int>& order, size_t& best, size_t budget)
+        {
+            size_t n = order.size();
+            std::vector<int> bins = order; // sift in current order
+            for (int bin : bins)
+            {
+                size_t pos = std::find(order.begin(), order.end(), bin) - order.begin();
+                std::vector<int> candidate = order;
+                candidate.erase(candidate.begin() + pos);
+                for (size_t level=0; level<n; level++)
+                {
+                    if (level == pos)
+                        continue;
+                    if (budget < n)
+                        return;
+                    budget -= n;
+
+                    std::vector<int> trial = candidate;
+                    trial.insert(trial.begin() + level, bin);
+                    size_t count = count_prefixes(columns, trial, best);
+                    if (count < best)
+                    {
+                        best = count;
+                        order = trial;
+                    }
+                }
+            }
+        }
+
+        // build tree from constraints, branching on bins in index order
+        bool build_from_constraints_helper(TreeNode* node, int bin_ind, ConstraintPropagator& propagator, std::vector<std::pair<int, bool>>& bins)
+        {
+            // leaf
+            if (bin_ind >= this->n_bins)
+            {
+                this->leaves.push_back(std::make_pair(node, bins)); // add to leaves
+                return true;
+            }
+
+            // create feasible branches and recurse
+            TreeNode* last = nullptr;
+            for (bool value : {false, true})
+            {
+                propagator.assign(bin_ind, value);
+                if (!propagator.conflict())
+                {
+                    TreeNode* new_node = node_pool.new_node(bin_ind, value);
+                    bins.push_back(std::make_pair(bin_ind, value));
+                    if (build_from_constraints_helper(new_node, bin_ind+1, propagator, bins))
+                        append_child(node, last, new_node);
+                    else
+                        node_pool.delete_node(new_node); // no feasible completion
+                    bins.pop_back();
+                }
+                propagator.unassign(bin_ind, value);
+            }
+            return node->firstchild != nullptr;
+        }
+
+        // build cardinality tree, only branches that can still reach a count in [lb, ub] are created
+        void build_cardinality_helper(TreeNode* node, int bin_ind, int count, int lb, int ub, std::vector<std::pair<int, bool>>& bins)
+        {
+            // leaf
+            if (bin_ind >= this->n_bins)
+            {
+                this->leaves.push_back(std::make_pair(node, bins)); // add to leaves
+                return;
+            }
+
+            TreeNode* last = nullptr;
+            int remaining = this->n_bins - bin_ind - 1; // binaries below the new node
+            for (bool value : {false, true})
+            {
+                int new_count = count + value;
+                if (new_count > ub || new_count + remaining < lb)
+                    continue;
+
+                TreeNode* new_node = node_pool.new_node(bin_ind, value);
+                append_child(node, last, new_node);
+                bins.push_back(std::make_pair(bin_ind, value));
+                build_cardinality_helper(new_node, bin_ind+1, new_count, lb, ub, bins);
+                bins.pop_back();
+            }
+        }
+
+        // collect the highest nodes whose path violates a constraint
+        static void prune_infeasible_helper(TreeNode* node, ConstraintPropagator& propagator, std::vector<TreeNode*>& pruned_nodes)
+        {
+            if (node->ind >= 0)
+                propagator.assign(node->ind, node->value);
+            if (propagator.conflict())
+                pruned_nodes.push_back(node);
+            else
+            {
+                for (TreeNode* child = node->firstchild; child; child = child->nextsibling)
+                    prune_infeasible_helper(child, propagator, pruned_nodes);
+            }
+            if (node->ind >= 0)
+                propagator.unassign(node->ind, node->value);
+        }
+
         // build tree from leaves
-        void build_from_leaves_helper(TreeNode* node, const std::vector<std::vector<std::pair<int, bool>>>& leaf_bins, int bin_ind)
+        void build_from_leaves_helper(TreeNode* node, const std::vector<std::vector<std::pair<int, bool>>>& leaf_bins, int bin_ind,
+            const std::vector<int>& order)
         {
             if (!node) return; // invalid
 
@@ -360,11 +3202,11 @@ class Tree
                 return;
             }
 
-            // get leaves corresponding to high and low values at the given index
+            // get leaves corresponding to high and low values at the given level
             std::vector<std::vector<std::pair<int, bool>>> low_leaves, high_leaves;
             for (auto it=leaf_bins.begin(); it!=leaf_bins.end(); ++it)
             {
-                if (it->at(bin_ind).second)
+                if (it->at(order[bin_ind]).second)
                     high_leaves.push_back(*it);
                 else
                     low_leaves.push_back(*it);
@@ -373,29 +3215,29 @@ class Tree
             // create new nodes and recurse
             if (low_leaves.size() > 0 && high_leaves.size() > 0)
             {
-                TreeNode* low_node = node_pool.new_node(bin_ind, false);
-                TreeNode* high_node = node_pool.new_node(bin_ind, true);
+                TreeNode* low_node = node_pool.new_node(order[bin_ind], false);
+                TreeNode* high_node = node_pool.new_node(order[bin_ind], true);
                 node->firstchild = low_node;
                 low_node->nextsibling = high_node;
                 low_node->previous = node;
                 high_node->previous = low_node;
 
-                build_from_leaves_helper(low_node, low_leaves, bin_ind+1);
-                build_from_leaves_helper(high_node, high_leaves, bin_ind+1);
+                build_from_leaves_helper(low_node, low_leaves, bin_ind+1, order);
+                build_from_leaves_helper(high_node, high_leaves, bin_ind+1, order);
             }
             else if (low_leaves.size() > 0)
             {
-                TreeNode* low_node = node_pool.new_node(bin_ind, false);
+                TreeNode* low_node = node_pool.new_node(order[bin_ind], false);
                 node->firstchild = low_node;
                 low_node->previous = node;
-                build_from_leaves_helper(low_node, low_leaves, bin_ind+1);
+                build_from_leaves_helper(low_node, low_leaves, bin_ind+1, order);
             }
             else if (high_leaves.size() > 0)
             {
-                TreeNode* high_node = node_pool.new_node(bin_ind, true);
+                TreeNode* high_node = node_pool.new_node(order[bin_ind], true);
                 node->firstchild = high_node;
                 high_node->previous = node;
-                build_from_leaves_helper(high_node, high_leaves, bin_ind+1);
+                build_from_leaves_helper(high_node, high_leaves, bin_ind+1, order);
             }
             else
             {
@@ -403,6 +3245,301 @@ class Tree
             }
         }
 
+        // set operation on two trees over the same binaries
+        static Tree apply(const Tree& tree1, const Tree& tree2, SetOp op)
+        {
+            if (tree1.n_bins != tree2.n_bins)
+                throw std::invalid_argument("Trees must have the same number of binaries");
+
+            // empty operands
+            bool empty1 = tree1.root->ind < 0 && !tree1.root->firstchild;
+            bool empty2 = tree2.root->ind < 0 && !tree2.root->firstchild;
+            if (!empty1 && empty2 && op != SetOp::Intersect)
+                return tree1;
+            if (empty1 && !empty2 && op == SetOp::Unite)
+                return tree2;
+            if (empty1 || empty2)
+            {
+                Tree new_tree; // empty
+                new_tree.n_bins = tree1.n_bins;
+                new_tree.prune_stats.resize(tree1.n_bins);
+                return new_tree;
+            }
+
+            // virtual roots so that labelled roots are handled like any other child
+            TreeNode root1, root2;
+            root1.firstchild = (tree1.root->ind < 0) ? tree1.root->firstchild : tree1.root;
+            root2.firstchild = (tree2.root->ind < 0) ? tree2.root->firstchild : tree2.root;
+
+            // walk both trees simultaneously
+            Tree new_tree; // empty root
+            new_tree.n_bins = tree1.n_bins;
+            new_tree.prune_stats.resize(tree1.n_bins);
+            std::vector<signed char> assigned(tree1.n_bins, -1); // binaries fixed on the current path
+            std::unordered_map<uint64_t, bool> meets; // node pair -> subtrees share an assignment
+            std::vector<const TreeNode*> branches1, branches2;
+            expand_assigned(&root1, assigned, branches1);
+            expand_assigned(&root2, assigned, branches2);
+            new_tree.apply_helper(branches1, false, branches2, false, op, new_tree.root, assigned, meets);
+            new_tree.update_subtree(new_tree.root);
+            new_tree.rebuild_leaves();
+            return new_tree;
+        }
+
+        // children of node under the assigned binaries appended to branches. Children testing an assigned
+        // binary are dropped or replaced by their own children, returns true if a leaf is reached that way
+        static bool expand_assigned(const TreeNode* node, const std::vector<signed char>& assigned, std::vector<const TreeNode*>& branches)
+        {
+            for (const TreeNode* child = node->firstchild; child; child = child->nextsibling)
+            {
+                if (assigned[child->ind] < 0)
+                {
+                    branches.push_back(child);
+                    continue;
+                }
+                if (assigned[child->ind] != child->value)
+                    continue; // conflicts with the path
+                if (!child->firstchild || expand_assigned(child, assigned, branches))
+                    return true; // contains every continuation of the path
+            }
+            return false;
+        }
+
+        // combine the branches of both trees below out, full if a leaf contains every continuation of the path.
+        // Branches are carried down unsplit, only the complement taken in subtract branches on both values of a
+        // binary. Returns false if the result is empty
+        bool apply_helper(const std::vector<const TreeNode*>& branches1, bool full1, const std::vector<const TreeNode*>& branches2, bool full2,
+            SetOp op, TreeNode* out, std::vector<signed char>& assigned, std::unordered_map<uint64_t, bool>& meets)
+        {
+            bool empty1 = !full1 && branches1.empty();
+            bool empty2 = !full2 && branches2.empty();
+            switch (op)
+            {
+                case SetOp::Intersect:
+                    if (empty1 || empty2)
+                        return false;
+                    if (full1 && full2)
+                        return true; // out is a leaf
+                    if (full1 || full2)
+                        return copy_branches(full1 ? branches2 : branches1, out, assigned);
+                    break;
+                case SetOp::Unite:
+                    if (full1 || full2)
+                        return true;
+                    if (empty1 || empty2)
+                        return copy_branches(empty1 ? branches2 : branches1, out, assigned);
+                    break;
+                case SetOp::Subtract:
+                    if (empty1 || full2)
+                        return false;
+                    if (empty2)
+                        return full1 || copy_branches(branches1, out, assigned);
+                    if (full1)
+                        return complement_branches(branches2, out, assigned);
+                    break;
+            }
+
+            TreeNode* last = nullptr;
+            std::vector<bool> matched(branches2.size(), false); // unite: branches of tree2 merged with a branch of tree1
+            for (const TreeNode* branch : branches1)
+            {
+                assigned[branch->ind] = branch->value;
+                std::vector<const TreeNode*> sub1, sub2;
+                bool sub_full1 = !branch->firstchild || expand_assigned(branch, assigned, sub1);
+                bool sub_full2 = false;
+                if (op == SetOp::Unite)
+                {
+                    // a sibling with the same label is continued below the same node
+                    size_t j = 0;
+                    while (j < branches2.size() && (matched[j] || branches2[j]->ind != branch->ind || branches2[j]->value != branch->value))
+                        ++j;
+                    if (j < branches2.size())
+                    {
+                        matched[j] = true;
+                        sub_full2 = !branches2[j]->firstchild || expand_assigned(branches2[j], assigned, sub2);
+                    }
+                }
+                else
+                {
+                    // branches of tree2 that meet this one, a branch that does not test the binary stays as it is
+                    sub_full2 = restrict_meeting(branch, branches2, assigned, meets, sub2);
+                }
+
+                bool skip = (op == SetOp::Intersect && !sub_full2 && sub2.empty()) || (op == SetOp::Subtract && sub_full2);
+                if (!skip)
+                {
+                    TreeNode* new_node = node_pool.new_node(branch->ind, branch->value);
+                    if (apply_helper(sub1, sub_full1, sub2, sub_full2, op, new_node, assigned, meets))
+                        append_child(out, last, new_node);
+                    else
+                        node_pool.delete_node(new_node);
+                }
+                assigned[branch->ind] = -1;
+            }
+
+            // branches of tree2 without a counterpart in tree1
+            if (op == SetOp::Unite)
+            {
+                for (size_t j=0; j<branches2.size(); j++)
+                {
+                    if (!matched[j])
+                        copy_branch(branches2[j], out, last, assigned);
+                }
+            }
+            return out->firstchild != nullptr;
+        }
+
+        // true if the subtrees of node1 and node2 share an assignment. node1 is applied in assigned, which holds
+        // exactly the labels on its path in tree1, so the answer depends on the pair alone and is memoized
+        bool meet(const TreeNode* node1, const TreeNode* node2, std::vector<signed char>& assigned, std::unordered_map<uint64_t, bool>& meets)
+        {
+            uint64_t key = (static_cast<uint64_t>(node1->id) << 32) | node2->id;
+            auto it = meets.find(key);
+            if (it != meets.end())
+                return it->second;
+
+            // continuations of node2 below the label of node1
+            std::vector<const TreeNode*> sub1, sub2;
+            bool result = false;
+            if (node2->ind != node1->ind)
+                sub2.push_back(node2);
+            else if (node2->value == node1->value && (!node2->firstchild || expand_assigned(node2, assigned, sub2)))
+            {
+                result = true; // contains every continuation
+                sub2.clear();
+            }
+
+            if (!result)
+            {
+                if (!node1->firstchild || expand_assigned(node1, assigned, sub1))
+                {
+                    for (size_t j=0; !result && j<sub2.size(); j++)
+                        result = satisfiable(sub2[j], assigned);
+                }
+                for (size_t i=0; !result && i<sub1.size(); i++)
+                {
+                    assigned[sub1[i]->ind] = sub1[i]->value;
+                    for (size_t j=0; !result && j<sub2.size(); j++)
+                        result = meet(sub1[i], sub2[j], assigned, meets);
+                    assigned[sub1[i]->ind] = -1;
+                }
+            }
+            meets.emplace(key, result);
+            return result;
+        }
+
+        // some continuation of node agrees with the assigned binaries
+        static bool satisfiable(const TreeNode* node, std::vector<signed char>& assigned)
+        {
+            assigned[node->ind] = node->value;
+            std::vector<const TreeNode*> children;
+            bool result = !node->firstchild || expand_assigned(node, assigned, children);
+            for (size_t i=0; !result && i<children.size(); i++)
+                result = satisfiable(children[i], assigned);
+            assigned[node->ind] = -1;
+            return result;
+        }
+
+        // branches that meet node (applied in assigned), continued below the label of node. Returns true if one
+        // of them contains every continuation
+        bool restrict_meeting(const TreeNode* node, const std::vector<const TreeNode*>& branches, std::vector<signed char>& assigned,
+            std::unordered_map<uint64_t, bool>& meets, std::vector<const TreeNode*>& restricted)
+        {
+            for (const TreeNode* branch : branches)
+            {
+                if (!meet(node, branch, assigned, meets))
+                    continue;
+                if (branch->ind != node->ind)
+                    restricted.push_back(branch); // tests the binary further down, if at all
+                else if (!branch->firstchild || expand_assigned(branch, assigned, restricted))
+                    return true;
+            }
+            return false;
+        }
+
+        // assignments contained in none of the branches, split on the binary tested first. Returns false if the
+        // branches contain every continuation
+        bool complement_branches(const std::vector<const TreeNode*>& branches, TreeNode* out, std::vector<signed char>& assigned)
+        {
+            int ind = branches[0]->ind;
+            TreeNode* last = nullptr;
+            for (bool value : {false, true})
+            {
+                assigned[ind] = value;
+                std::vector<const TreeNode*> sub;
+                if (!restrict_branches(branches, ind, value, assigned, sub))
+                {
+                    TreeNode* new_node = node_pool.new_node(ind, value);
+                    if (sub.empty() || complement_branches(sub, new_node, assigned))
+                        append_child(out, last, new_node);
+                    else
+                        node_pool.delete_node(new_node);
+                }
+            }
+            assigned[ind] = -1;
+            return out->firstchild != nullptr;
+        }
+
+        // branches that agree with ind = value, returns true if one of them contains every continuation
+        static bool restrict_branches(const std::vector<const TreeNode*>& branches, int ind, bool value, const std::vector<signed char>& assigned,
+            std::vector<const TreeNode*>& restricted)
+        {
+            for (const TreeNode* branch : branches)
+            {
+                if (branch->ind != ind)
+                    restricted.push_back(branch); // tests ind further down, if at all
+                else if (branch->value == value && (!branch->firstchild || expand_assigned(branch, assigned, restricted)))
+                    return true;
+            }
+            return false;
+        }
+
+        // copy branches below out without the tests of assigned binaries, returns false if nothing is left
+        bool copy_branches(const std::vector<const TreeNode*>& branches, TreeNode* out, std::vector<signed char>& assigned)
+        {
+            TreeNode* last = nullptr;
+            for (const TreeNode* branch : branches)
+                copy_branch(branch, out, last, assigned);
+            return out->firstchild != nullptr;
+        }
+
+        // copy one branch after last, dropped if nothing of it is left
+        void copy_branch(const TreeNode* branch, TreeNode* out, TreeNode*& last, std::vector<signed char>& assigned)
+        {
+            TreeNode* new_node = node_pool.new_node(branch->ind, branch->value);
+            assigned[branch->ind] = branch->value;
+            std::vector<const TreeNode*> children;
+            bool keep = !branch->firstchild || expand_assigned(branch, assigned, children) || copy_branches(children, new_node, assigned);
+            assigned[branch->ind] = -1;
+
+            if (keep)
+                append_child(out, last, new_node);
+            else
+                node_pool.delete_node(new_node);
+        }
+
+        // append node to the children of parent, last is the current last child
+        static void append_child(TreeNode* parent, TreeNode*& last, TreeNode* node)
+        {
+            if (last)
+            {
+                last->nextsibling = node;
+                node->previous = last;
+            }
+            else
+            {
+                parent->firstchild = node;
+                node->previous = parent;
+            }
+            last = node;
+        }
+
+        // order nodes by (ind, value)
+        static bool label_less(const TreeNode* a, const TreeNode* b)
+        {
+            return (a->ind < b->ind) || (a->ind == b->ind && a->value < b->value);
+        }
+
         #ifdef PRUNABLE_TREE_DEBUG
         void get_leaf_bins_propagate_helper(const TreeNode* node, std::vector<std::vector<std::pair<int, bool>>>& leaves,
             std::vector<std::pair<int, bool>> bins) const
@@ -430,68 +3567,162 @@ Tree vcat(const Tree& tree1, const Tree& tree2)
     // init new tree
     Tree new_tree = tree1; // copy constructor
     new_tree.n_bins += tree2.n_bins; // update number of bins
+    new_tree.prune_stats.insert(new_tree.prune_stats.end(), tree2.prune_stats.begin(), tree2.prune_stats.end()); // shifted like the binaries
+    new_tree.clear_alternatives(); // tree2 binaries lie outside the alternatives
 
     // traverse and copy from leaves
     std::vector<std::pair<TreeNode*, std::vector<std::pair<int, bool>>>> old_leaves = new_tree.leaves; // copy
     new_tree.leaves.clear(); // clear leaves
     for (auto& leaf : old_leaves)
     {
+        size_t n_leaves = new_tree.leaves.size();
+        double weight = new_tree.min_weight(leaf.first);
         leaf.first->firstchild = new_tree.traverse_and_copy(tree2.root, leaf.first, leaf.second, tree1.n_bins);
+
+        // weights add up along the concatenation, new leaves match the leaves of tree2 in preorder
+        if (!new_tree.track_weights && !tree2.track_weights)
+            continue;
+        new_tree.enable_weights();
+        for (size_t i=n_leaves; i<new_tree.leaves.size(); i++)
+        {
+            TreeNode* new_leaf = new_tree.leaves[i].first;
+            if (new_leaf != leaf.first)
+                new_tree.set_weight(new_leaf, weight + tree2.min_weight(tree2.leaves[i - n_leaves].first));
+        }
     }
+    new_tree.update_subtree(new_tree.root);
     
     return new_tree;
 }
 
-// horizontal concatenation
-Tree hcat(const std::vector<Tree>& trees)
+// horizontal concatenation, inputs built by hcat are spliced into a single disjunction if flatten is set
+Tree hcat(const std::vector<Tree>& trees, HcatEncoding encoding = HcatEncoding::OneHot, bool flatten = true)
 {
-    // track new binary variables
+    // alternatives to copy: first node, offset of its binaries in the input tree, number of binaries,
+    // input tree and index of the first leaf of the alternative in it
+    struct Source { TreeNode* node; int offset; int n_bins; bool present; const Tree* tree; size_t first_leaf; };
+    std::vector<Source> sources; // init
+    for (const auto& tree : trees)
+    {
+        if (flatten && !tree.alternatives.empty())
+        {
+            // splice alternatives, inner indicators are dropped
+            for (size_t i=0; i<tree.alternatives.size(); i++)
+            {
+                TreeNode* node = tree.find_alternative(i);
+                size_t first_leaf = node ? tree.leaf_range(node).first : 0;
+                sources.push_back({node ? node->firstchild : nullptr, tree.alternatives[i].offset, tree.alternatives[i].n_bins, node != nullptr, &tree, first_leaf});
+            }
+        }
+        else
+            sources.push_back({tree.root, 0, tree.n_bins, true, &tree, 0});
+    }
+
+    // one-hot: binaries of each alternative followed by its indicator, logarithmic: shared indicators last
     int n_bins = 0; // init
-    std::vector<int> new_bins; // init
-    for (auto& tree : trees)
+    std::vector<Alternative> alternatives; // init
+    for (const auto& source : sources)
+    {
+        Alternative alt; // init
+        alt.offset = n_bins;
+        alt.n_bins = source.n_bins;
+        n_bins += source.n_bins;
+        alt.indicator = (encoding == HcatEncoding::OneHot) ? n_bins++ : -1;
+        alternatives.push_back(alt);
+    }
+    int n_indicators = 0;
+    if (encoding == HcatEncoding::Logarithmic)
     {
-        new_bins.push_back(n_bins + tree.n_bins);
-        n_bins += tree.n_bins+1; // update total number of binaries
+        while ((size_t(1) << n_indicators) < sources.size())
+            ++n_indicators;
+        for (auto& alt : alternatives)
+            alt.indicator = n_bins;
     }
 
     // init new tree
-    Tree new_tree(-1, false, n_bins); // empty root
+    Tree new_tree(-1, false, n_bins + n_indicators); // empty root
     new_tree.leaves.clear();
 
-    // manually add children
-    for (size_t i=0; i<trees.size(); i++)
+    TreeNode* last = nullptr; // last indicator below the root (one-hot)
+    for (size_t i=0; i<sources.size(); i++)
     {
-        // first child
-        if (i == 0)
+        if (!sources[i].present) // pruned alternative, binaries stay reserved
+            continue;
+
+        TreeNode* node = new_tree.root;
+        std::vector<std::pair<int, bool>> bins; // init
+        if (encoding == HcatEncoding::OneHot)
         {
-            TreeNode* node = new_tree.node_pool.new_node(new_bins[i], true);
-            node->previous = new_tree.root;
-            new_tree.root->firstchild = node;
-            new_tree.leaves.push_back({node, {{node->ind, node->value}}});
+            node = new_tree.node_pool.new_node(alternatives[i].indicator, true);
+            Tree::append_child(new_tree.root, last, node);
+            bins.push_back(std::make_pair(node->ind, node->value));
         }
         else
         {
-            TreeNode* node = new_tree.node_pool.new_node(new_bins[i], true);
-            node->previous = new_tree.root;
-            new_tree.leaves[i-1].first->nextsibling = node;
-            new_tree.leaves.push_back({node, {{node->ind, node->value}}});
+            // binary selector, bit pattern of i (most significant bit first)
+            for (int j=0; j<n_indicators; j++)
+            {
+                int ind = n_bins + j;
+                bool value = (i >> (n_indicators - 1 - j)) & 1;
+                TreeNode* prev = nullptr;
+                TreeNode* child = node->firstchild;
+                while (child && child->value != value)
+                {
+                    prev = child;
+                    child = child->nextsibling;
+                }
+                if (!child) // unused patterns are never created
+                {
+                    child = new_tree.node_pool.new_node(ind, value);
+                    Tree::append_child(node, prev, child);
+                }
+                bins.push_back(std::make_pair(ind, value));
+                node = child;
+            }
         }
-    }
 
-    // traverse and copy from leaves
-    std::vector<std::pair<TreeNode*, std::vector<std::pair<int, bool>>>> old_leaves = new_tree.leaves; // copy
-    new_tree.leaves.clear(); // clear leaves
-    n_bins = 0; // re-init
-    for (size_t i=0; i<old_leaves.size(); i++)
-    {
-        old_leaves[i].first->firstchild = new_tree.traverse_and_copy(trees[i].root, old_leaves[i].first, old_leaves[i].second, n_bins);
-        n_bins += trees[i].n_bins + 1; // update total number of binaries
+        // copy alternative below its indicators
+        size_t n_leaves = new_tree.leaves.size();
+        node->firstchild = new_tree.traverse_and_copy(sources[i].node, node, bins, alternatives[i].offset - sources[i].offset);
+
+        // leaf weights, the leaves of an alternative are contiguous in its tree
+        const Tree& source = *sources[i].tree;
+        if (!source.track_weights)
+            continue;
+        new_tree.enable_weights();
+        for (size_t j=n_leaves; j<new_tree.leaves.size(); j++)
+        {
+            if (new_tree.leaves[j].first != node) // empty alternative
+                new_tree.set_weight(new_tree.leaves[j].first, source.min_weight(source.leaves[sources[i].first_leaf + j - n_leaves].first));
+        }
     }
+    new_tree.alternatives = alternatives;
+    new_tree.hcat_encoding = encoding;
+    new_tree.update_subtree(new_tree.root);
 
     return new_tree;
 }
 
 
+// set intersection, assignments contained in both trees
+Tree intersect(const Tree& tree1, const Tree& tree2)
+{
+    return Tree::apply(tree1, tree2, Tree::SetOp::Intersect);
+}
+
+// set union, assignments contained in either tree
+Tree unite(const Tree& tree1, const Tree& tree2)
+{
+    return Tree::apply(tree1, tree2, Tree::SetOp::Unite);
+}
+
+// set difference, assignments contained in tree1 but not in tree2
+Tree subtract(const Tree& tree1, const Tree& tree2)
+{
+    return Tree::apply(tree1, tree2, Tree::SetOp::Subtract);
+}
+
+
 // print tree
 std::ostream& operator<<(std::ostream& os, const Tree& tree)
 {
@@ -523,4 +3754,31 @@ std::ostream& operator<<(std::ostream& os, const Tree& tree)
 }
 
 
+// structural equality
+bool operator==(const Tree& tree1, const Tree& tree2)
+{
+    if (tree1.n_bins != tree2.n_bins || tree1.root->ind != tree2.root->ind)
+        return false;
+    return Tree::equal_helper(tree1.root, tree2.root);
+}
+
+bool operator!=(const Tree& tree1, const Tree& tree2)
+{
+    return !(tree1 == tree2);
+}
+
+// hash support
+namespace std
+{
+    template<>
+    struct hash<Tree>
+    {
+        size_t operator()(const Tree& tree) const
+        {
+            return static_cast<size_t>(tree.get_hash());
+        }
+    };
+}
+
+
 #endif
\ No newline at end of file
@@ -0,0 +1,157 @@
+#include <iostream>
+#include <chrono>
+#include <random>
+#include <string>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "PrunableTree.hpp"
+
+// data TLB read misses of the calling thread, reports -1 if performance counters are unavailable
+class DtlbCounter
+{
+    public:
+        DtlbCounter()
+        {
+            #if defined(__linux__)
+            perf_event_attr attr = {};
+            attr.type = PERF_TYPE_HW_CACHE;
+            attr.size = sizeof(attr);
+            attr.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+            attr.disabled = 1;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            this->fd = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+            #endif
+        }
+
+        ~DtlbCounter()
+        {
+            #if defined(__linux__)
+            if (this->fd >= 0)
+                close(this->fd);
+            #endif
+        }
+
+        void start()
+        {
+            #if defined(__linux__)
+            if (this->fd >= 0)
+            {
+                ioctl(this->fd, PERF_EVENT_IOC_RESET, 0);
+                ioctl(this->fd, PERF_EVENT_IOC_ENABLE, 0);
+            }
+            #endif
+        }
+
+        long long stop()
+        {
+            long long count = -1;
+            #if defined(__linux__)
+            if (this->fd >= 0)
+            {
+                ioctl(this->fd, PERF_EVENT_IOC_DISABLE, 0);
+                if (read(this->fd, &count, sizeof(count)) != sizeof(count))
+                    count = -1;
+            }
+            #endif
+            return count;
+        }
+
+    private:
+        int fd = -1;
+};
+
+// serial descents against the batched interleaved lookup, returns false on mismatching results
+bool run_lookups(const Tree& tree, const std::vector<std::vector<bool>>& queries)
+{
+    DtlbCounter counter;
+    size_t n_queries = queries.size();
+
+    // serial
+    counter.start();
+    auto start = std::chrono::steady_clock::now();
+    std::vector<const TreeNode*> serial(n_queries);
+    for (size_t q=0; q<n_queries; q++)
+        serial[q] = tree.find_leaf(queries[q]);
+    double serial_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    long long serial_misses = counter.stop();
+
+    // batched
+    counter.start();
+    start = std::chrono::steady_clock::now();
+    std::vector<const TreeNode*> batched = tree.find_leaves(queries);
+    double batched_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    long long batched_misses = counter.stop();
+
+    size_t n_found = 0;
+    for (size_t q=0; q<n_queries; q++)
+    {
+        if (serial[q] != batched[q])
+        {
+            std::cout << "mismatch at query " << q << std::endl;
+            return false;
+        }
+        n_found += (serial[q] != nullptr);
+    }
+
+    std::cout << "  found " << n_found << " of " << n_queries << std::endl;
+    std::cout << "  serial:  " << serial_time << " s, " << n_queries / serial_time / 1e6 << " M lookups/s, dTLB misses ";
+    std::cout << (serial_misses < 0 ? std::string("n/a") : std::to_string(serial_misses)) << std::endl;
+    std::cout << "  batched: " << batched_time << " s, " << n_queries / batched_time / 1e6 << " M lookups/s, dTLB misses ";
+    std::cout << (batched_misses < 0 ? std::string("n/a") : std::to_string(batched_misses)) << std::endl;
+    std::cout << "  speedup: " << serial_time / batched_time << std::endl;
+    return true;
+}
+
+// membership lookups on a random tree, with nodes on regular and on transparent huge pages
+int main(int argc, char* argv[])
+{
+    size_t n_leaves = (argc > 1) ? std::stoul(argv[1]) : 200000;
+    int n_bins = (argc > 2) ? std::stoi(argv[2]) : 32;
+    size_t n_queries = (argc > 3) ? std::stoul(argv[3]) : 1000000;
+
+    std::mt19937_64 rng(0);
+
+    // random leaves
+    std::vector<std::vector<std::pair<int, bool>>> leaf_bins(n_leaves);
+    for (auto& leaf : leaf_bins)
+    {
+        for (int i=0; i<n_bins; i++)
+            leaf.push_back(std::make_pair(i, static_cast<bool>(rng() & 1)));
+    }
+
+    // queries, half of them leaves of the tree
+    std::vector<std::vector<bool>> queries(n_queries, std::vector<bool>(n_bins));
+    for (size_t q=0; q<n_queries; q++)
+    {
+        if (q % 2 == 0)
+        {
+            const auto& leaf = leaf_bins[rng() % n_leaves];
+            for (int i=0; i<n_bins; i++)
+                queries[q][i] = leaf[i].second;
+        }
+        else
+        {
+            for (int i=0; i<n_bins; i++)
+                queries[q][i] = rng() & 1;
+        }
+    }
+
+    for (bool huge_pages : {false, true})
+    {
+        NodePool::set_default_huge_pages(huge_pages);
+        Tree tree(leaf_bins);
+        std::cout << (huge_pages ? "huge pages" : "regular pages") << ": n_bins = " << tree.get_n_bins() << ", n_leaves = " << tree.get_n_leaves();
+        std::cout << ", n_nodes = " << tree.get_n_nodes() << std::endl;
+        if (!run_lookups(tree, queries))
+            return 1;
+    }
+
+    return 0;
+}
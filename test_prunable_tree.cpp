@@ -1,8 +1,1340 @@
 #include <iostream>
+#include <map>
+#include <random>
+#include <set>
 
 #define PRUNABLE_TREE_DEBUG
 #include "PrunableTree.hpp"
 
+int n_failed = 0;
+
+void check(bool ok, const std::string& what)
+{
+    if (!ok)
+    {
+        std::cout << "FAILED: " << what << std::endl;
+        ++n_failed;
+    }
+}
+
+// assignment number x, bit i is binary i
+std::vector<bool> assignment(int n_bins, int x)
+{
+    std::vector<bool> values(n_bins);
+    for (int i=0; i<n_bins; i++)
+        values[i] = (x >> i) & 1;
+    return values;
+}
+
+// leaves as sorted bin lists, independent of branching order
+std::vector<std::vector<std::pair<int, bool>>> leaf_set(const Tree& tree)
+{
+    std::vector<std::vector<std::pair<int, bool>>> leaves = tree.get_leaf_bins();
+    for (auto& leaf : leaves)
+        std::sort(leaf.begin(), leaf.end());
+    std::sort(leaves.begin(), leaves.end());
+    return leaves;
+}
+
+// random subset of the 2^n_bins assignments, every leaf assigns every binary
+Tree random_tree(int n_bins, std::mt19937& gen)
+{
+    std::vector<std::vector<std::pair<int, bool>>> leaf_bins;
+    for (int x=0; x<(1 << n_bins); x++)
+    {
+        if (gen() % 2)
+            continue;
+        std::vector<std::pair<int, bool>> leaf;
+        for (int i=0; i<n_bins; i++)
+            leaf.push_back(std::make_pair(i, (x >> i) & 1));
+        leaf_bins.push_back(leaf);
+    }
+    return Tree(leaf_bins);
+}
+
+// membership of every assignment, assignment number x at index x
+std::vector<bool> members(const Tree& tree)
+{
+    int n_bins = static_cast<int>(tree.get_n_bins());
+    std::vector<bool> in(1 << n_bins);
+    for (int x=0; x<(1 << n_bins); x++)
+        in[x] = tree.contains(assignment(n_bins, x));
+    return in;
+}
+
+// one-hot disjunction of k copies of exactly_one(2)
+Tree one_hot(int k)
+{
+    return hcat(std::vector<Tree>(k, Tree::exactly_one(2)));
+}
+
+void preorder_leaves(const TreeNode* node, std::vector<const TreeNode*>& leaves)
+{
+    if (!node->firstchild)
+    {
+        leaves.push_back(node);
+        return;
+    }
+    for (const TreeNode* child = node->firstchild; child; child = child->nextsibling)
+        preorder_leaves(child, leaves);
+}
+
+void check_set_operations()
+{
+    const int n_bins = 4;
+    std::mt19937 gen(0);
+    for (int trial=0; trial<50; trial++)
+    {
+        Tree tree1 = random_tree(n_bins, gen);
+        Tree tree2 = random_tree(n_bins, gen);
+        Tree reordered(tree2);
+        if (tree2.get_n_leaves() > 0)
+            reordered.reorder();
+
+        // the second operand also in another branching order
+        std::vector<bool> in1 = members(tree1);
+        for (const Tree* other : {&tree2, &reordered})
+        {
+            std::vector<bool> in2 = members(*other);
+            std::vector<bool> both = members(intersect(tree1, *other));
+            std::vector<bool> either = members(unite(tree1, *other));
+            std::vector<bool> diff = members(subtract(tree1, *other));
+            for (int x=0; x<(1 << n_bins); x++)
+            {
+                check(both[x] == (in1[x] && in2[x]), "intersect");
+                check(either[x] == (in1[x] || in2[x]), "unite");
+                check(diff[x] == (in1[x] && !in2[x]), "subtract");
+            }
+        }
+    }
+
+    // operands whose branches test different binaries, the result must not split on binaries a branch never tests
+    for (int k : {3, 12, 16})
+    {
+        Tree tree = one_hot(k);
+        Tree pruned(tree);
+        pruned.prune_leaves({0, 3});
+        check(intersect(tree, tree).get_n_nodes() == tree.get_n_nodes(), "intersect of an hcat tree with itself keeps its size");
+        check(unite(tree, tree).get_n_nodes() == tree.get_n_nodes(), "unite of an hcat tree with itself keeps its size");
+        check(subtract(tree, tree).get_n_leaves() == 0, "subtract of an hcat tree from itself");
+        check(intersect(tree, pruned).get_n_nodes() <= 3 * tree.get_n_nodes(), "intersect of hcat trees stays linear");
+        if (k == 3)
+        {
+            std::vector<bool> in1 = members(tree), in2 = members(pruned);
+            std::vector<bool> both = members(intersect(tree, pruned)), diff = members(subtract(tree, pruned));
+            for (size_t x=0; x<in1.size(); x++)
+                check(both[x] == (in1[x] && in2[x]) && diff[x] == (in1[x] && !in2[x]), "set operations on hcat trees");
+        }
+    }
+}
+
+void check_canonical()
+{
+    const int n_bins = 4;
+    std::mt19937 gen(10);
+    for (int trial=0; trial<50; trial++)
+    {
+        Tree tree = random_tree(n_bins, gen);
+        if (tree.get_n_leaves() < 2)
+            continue;
+
+        // the same leaves inserted in another order give other sibling orders, but the same hash
+        std::vector<std::vector<std::pair<int, bool>>> leaf_bins = tree.get_leaf_bins();
+        std::shuffle(leaf_bins.begin(), leaf_bins.end(), gen);
+        Tree shuffled({leaf_bins[0]});
+        for (size_t i=1; i<leaf_bins.size(); i++)
+            shuffled.insert_leaf(leaf_bins[i]);
+        check(shuffled == tree && shuffled.get_hash() == tree.get_hash(), "hash independent of sibling order");
+        shuffled.canonicalize();
+        check(shuffled.get_leaf_bins() == tree.get_leaf_bins(), "canonical sibling order");
+
+        // hashes follow prunes
+        std::vector<bool> values(n_bins);
+        for (const auto& bin : leaf_bins[gen() % leaf_bins.size()])
+            values[bin.first] = bin.second;
+        tree.prune_leaves({static_cast<int>(tree.rank(tree.find_leaf(values)))});
+        shuffled.prune_leaves({static_cast<int>(shuffled.rank(shuffled.find_leaf(values)))});
+        check(shuffled == tree && shuffled.get_hash() == tree.get_hash(), "hash after prune");
+        check(tree.get_hash() == Tree(tree.get_leaf_bins()).get_hash(), "hash after prune matches a rebuilt tree");
+    }
+}
+
+// no two siblings below node test the same binary with the same value
+bool distinct_siblings(const TreeNode* node)
+{
+    std::set<std::pair<int, bool>> labels;
+    for (const TreeNode* child = node->firstchild; child; child = child->nextsibling)
+        if (!labels.insert(std::make_pair(child->ind, child->value)).second || !distinct_siblings(child))
+            return false;
+    return true;
+}
+
+void check_reduce()
+{
+    // set operations on partial cubes leave siblings with equal labels behind
+    Tree cubes = unite(Tree({{{0, true}, {1, false}}}), Tree(1, false, 2));
+    Tree tree = intersect(Tree(0, true, 2), cubes);
+    std::vector<bool> in = members(tree);
+    size_t n_nodes = tree.get_n_nodes();
+    size_t n_removed = tree.reduce();
+    check(n_removed > 0, "reduce merges duplicate siblings");
+    check(tree.get_n_nodes() == n_nodes - n_removed, "reduce returns the number of nodes removed");
+    check(members(tree) == in && distinct_siblings(tree.get_root()), "reduce of an intersection");
+
+    // unions of random cubes over few binaries, and their intersections
+    const int n_bins = 4;
+    std::mt19937 gen(11);
+    auto random_cubes = [&]()
+    {
+        Tree tree(gen() % n_bins, gen() % 2, n_bins);
+        for (int i=0; i<3; i++)
+        {
+            Tree cube(gen() % n_bins, gen() % 2, n_bins);
+            tree = unite(tree, gen() % 2 ? cube : intersect(Tree(gen() % n_bins, gen() % 2, n_bins), cube));
+        }
+        return tree;
+    };
+    size_t n_reduced = 0;
+    for (int trial=0; trial<200; trial++)
+    {
+        Tree tree1 = random_cubes();
+        Tree tree2 = random_cubes();
+        for (Tree tree : {intersect(tree1, tree2), unite(tree1, tree2)})
+        {
+            std::vector<bool> in = members(tree);
+            size_t n_nodes = tree.get_n_nodes();
+            size_t n_removed = tree.reduce();
+            n_reduced += n_removed > 0;
+            check(tree.get_n_nodes() == n_nodes - n_removed, "reduce returns the number of nodes removed");
+            check(members(tree) == in, "reduce keeps the assignments");
+            check(distinct_siblings(tree.get_root()), "reduce leaves distinct siblings");
+            check(tree.get_n_leaves() == tree.get_leaf_bins().size(), "leaf count after reduce");
+            check(tree.reduce() == 0, "reduce is idempotent");
+        }
+    }
+    check(n_reduced > 0, "random cubes give duplicate siblings");
+}
+
+void check_reorder()
+{
+    const int n_bins = 4;
+    std::mt19937 gen(1);
+    for (int trial=0; trial<50; trial++)
+    {
+        Tree tree = random_tree(n_bins, gen);
+        if (tree.get_n_leaves() == 0)
+            continue;
+
+        // reordering keeps the leaves and their weights
+        std::vector<double> weights;
+        for (size_t i=0; i<tree.get_n_leaves(); i++)
+            weights.push_back(static_cast<double>(gen() % 10));
+        tree.set_leaf_weights(weights);
+        Tree reordered(tree);
+        reordered.reorder(trial % 2 ? ReorderStrategy::Static : ReorderStrategy::Sifting);
+        check(leaf_set(reordered) == leaf_set(tree), "reorder keeps the leaves");
+        for (int x=0; x<(1 << n_bins); x++)
+        {
+            const TreeNode* leaf = tree.find_leaf(assignment(n_bins, x));
+            const TreeNode* moved = reordered.find_leaf(assignment(n_bins, x));
+            if (leaf && moved)
+                check(tree.get_leaf_weight(leaf) == reordered.get_leaf_weight(moved), "reorder keeps the leaf weights");
+        }
+    }
+}
+
+void check_project()
+{
+    std::mt19937 gen(2);
+    std::vector<Tree> trees = {hcat({Tree(0, true, 1), Tree(0, false, 1)})};
+    for (int trial=0; trial<20; trial++)
+    {
+        trees.push_back(random_tree(4, gen));
+        Tree tree = hcat({Tree::exactly_one(2), Tree(0, gen() % 2, 1)});
+        tree.prune_leaves({static_cast<int>(gen() % tree.get_n_leaves())});
+        trees.push_back(tree);
+    }
+
+    // projection onto every subset of the binaries
+    for (const Tree& tree : trees)
+    {
+        int n_bins = static_cast<int>(tree.get_n_bins());
+        std::vector<bool> in = members(tree);
+        for (int mask=0; mask<(1 << n_bins); mask++)
+        {
+            std::vector<int> keep_bins;
+            for (int i=0; i<n_bins; i++)
+            {
+                if ((mask >> i) & 1)
+                    keep_bins.push_back(i);
+            }
+            Tree projected = tree.project(keep_bins);
+            check(projected.get_n_leaves() == projected.get_leaf_bins().size(), "project leaf count");
+            std::vector<bool> projected_in = members(projected);
+            for (int x=0; x<(1 << n_bins); x++)
+            {
+                bool extends = false;
+                for (int y=0; y<(1 << n_bins); y++)
+                {
+                    if (((x ^ y) & mask) == 0 && in[y])
+                        extends = true;
+                }
+                check(projected_in[x] == extends, "project");
+            }
+        }
+    }
+}
+
+// compare the fixings implied below node with the leaves below it, returns those leaves
+std::vector<std::vector<std::pair<int, bool>>> check_fixings(const Tree& tree, const TreeNode* node, std::vector<std::pair<int, bool>>& path)
+{
+    if (node->ind >= 0)
+        path.push_back(std::make_pair(node->ind, node->value));
+    std::vector<std::vector<std::pair<int, bool>>> leaves; // init
+    if (!node->firstchild)
+        leaves.push_back(path);
+    for (const TreeNode* child = node->firstchild; child; child = child->nextsibling)
+        for (const auto& leaf : check_fixings(tree, child, path))
+            leaves.push_back(leaf);
+    if (node->ind >= 0)
+        path.pop_back();
+
+    std::vector<std::pair<int, bool>> fixed_bins; // binaries with one value in every leaf
+    for (int i=0; i<static_cast<int>(tree.get_n_bins()); i++)
+        for (bool value : {false, true})
+            if (std::all_of(leaves.begin(), leaves.end(), [&](const std::vector<std::pair<int, bool>>& leaf)
+                {
+                    return std::find(leaf.begin(), leaf.end(), std::make_pair(i, value)) != leaf.end();
+                }))
+                fixed_bins.push_back(std::make_pair(i, value));
+    check(tree.get_implied_fixings(node) == fixed_bins, "implied fixings");
+    return leaves;
+}
+
+void check_fixings()
+{
+    const int n_bins = 5;
+    std::mt19937 gen(12);
+    for (int trial=0; trial<50; trial++)
+    {
+        // full leaves, then leaves that stop early
+        Tree tree = random_tree(n_bins, gen);
+        if (tree.get_n_leaves() == 0)
+            continue;
+        tree.track_implied_fixings();
+        std::vector<std::pair<int, bool>> path;
+        check_fixings(tree, tree.get_root(), path);
+        for (int i=0; i<3; i++)
+        {
+            tree.insert_leaf({{0, true}, {1, static_cast<bool>(gen() % 2)}});
+            if (tree.get_n_leaves() > 1)
+                tree.prune_leaves({static_cast<int>(gen() % tree.get_n_leaves())});
+            check_fixings(tree, tree.get_root(), path);
+            check(tree.get_global_fixings() == tree.get_implied_fixings(tree.get_root()), "global fixings");
+        }
+    }
+
+    // a single leaf fixes every binary on its path
+    std::vector<std::pair<int, bool>> leaf = {{0, false}, {1, true}, {2, true}};
+    Tree tree({leaf});
+    tree.track_implied_fixings();
+    check(tree.get_global_fixings() == leaf, "global fixings of a single leaf");
+
+    Tree untracked(1, true, 2);
+    bool threw = false;
+    try
+    {
+        untracked.get_global_fixings();
+    }
+    catch (const std::logic_error&)
+    {
+        threw = true;
+    }
+    check(threw, "fixings must be tracked before they are queried");
+}
+
+// root to node path of every node, in preorder
+void node_paths(const TreeNode* node, std::vector<const TreeNode*>& path, std::vector<std::vector<const TreeNode*>>& paths)
+{
+    path.push_back(node);
+    paths.push_back(path);
+    for (const TreeNode* child = node->firstchild; child; child = child->nextsibling)
+        node_paths(child, path, paths);
+    path.pop_back();
+}
+
+void check_lca()
+{
+    const int n_bins = 5;
+    std::mt19937 gen(13);
+    for (int trial=0; trial<30; trial++)
+    {
+        Tree tree = random_tree(n_bins, gen);
+        for (int round=0; round<3 && tree.get_n_leaves() > 1; round++)
+        {
+            std::vector<const TreeNode*> path;
+            std::vector<std::vector<const TreeNode*>> paths;
+            node_paths(tree.get_root(), path, paths);
+
+            // deepest node on both paths
+            for (const auto& path1 : paths)
+                for (const auto& path2 : paths)
+                {
+                    size_t depth = 0;
+                    while (depth < path1.size() && depth < path2.size() && path1[depth] == path2[depth])
+                        depth++;
+                    check(tree.lca(path1.back(), path2.back()) == path1[depth-1], "lca");
+                }
+
+            // decisions down to the deepest node shared by a few leaves
+            std::vector<const TreeNode*> leaf_nodes;
+            std::vector<std::vector<std::pair<int, bool>>> leaf_bins;
+            for (int i=0; i<3; i++)
+            {
+                size_t k = gen() % tree.get_n_leaves();
+                leaf_nodes.push_back(tree.select_leaf(k));
+                leaf_bins.push_back(tree.get_leaf_bins()[k]);
+            }
+            std::vector<std::pair<int, bool>> prefix; // init
+            for (size_t depth=0; depth<leaf_bins[0].size(); depth++)
+            {
+                if (std::any_of(leaf_bins.begin(), leaf_bins.end(), [&](const std::vector<std::pair<int, bool>>& leaf)
+                    {
+                        return depth >= leaf.size() || leaf[depth] != leaf_bins[0][depth];
+                    }))
+                    break;
+                prefix.push_back(leaf_bins[0][depth]);
+            }
+            check(tree.common_prefix(leaf_nodes) == prefix, "common_prefix");
+            check(tree.common_prefix({leaf_nodes[0]}) == leaf_bins[0], "common_prefix of one leaf");
+
+            // the index is rebuilt after the tree changes, inserted leaves add new nodes
+            tree.prune_leaves({static_cast<int>(gen() % tree.get_n_leaves())});
+            for (int x=0; x<(1 << n_bins); x++)
+            {
+                std::vector<bool> values = assignment(n_bins, x);
+                if (gen() % 4 == 0 && !tree.contains(values))
+                {
+                    std::vector<std::pair<int, bool>> leaf;
+                    for (int i=0; i<n_bins; i++)
+                        leaf.push_back(std::make_pair(i, values[i]));
+                    tree.insert_leaf(leaf);
+                }
+            }
+        }
+    }
+    check(Tree(0, true, 1).common_prefix({}).empty(), "common_prefix of no leaves");
+}
+
+void check_presolve()
+{
+    // every assignment of the original is a fixed extension of one of the presolved tree
+    std::mt19937 gen(5);
+    std::vector<Tree> trees = {Tree({{{0, true}, {1, false}}}), Tree(0, true, 1)};
+    for (int trial=0; trial<50; trial++)
+    {
+        Tree tree = hcat({Tree::exactly_one(2), Tree(0, gen() % 2, 1), Tree::exactly_one(2)});
+        while (tree.get_n_leaves() > 1 + gen() % 2)
+            tree.prune_leaves({static_cast<int>(gen() % tree.get_n_leaves())});
+        trees.push_back(tree);
+    }
+    for (const Tree& tree : trees)
+    {
+        Tree presolved(tree);
+        PresolveInfo info = presolved.presolve();
+        check(presolved.get_n_leaves() > 0 && presolved.get_n_leaves() == presolved.get_leaf_bins().size(), "presolve keeps a feasible tree non-empty");
+
+        int n_bins = static_cast<int>(tree.get_n_bins());
+        std::vector<bool> in = members(tree);
+        for (int x=0; x<(1 << n_bins); x++)
+        {
+            std::vector<bool> values = assignment(n_bins, x);
+            std::vector<bool> kept(presolved.get_n_bins());
+            bool agrees = true;
+            for (const auto& bin : info.fixed_bins)
+                agrees = agrees && values[bin.first] == bin.second;
+            for (int i=0; i<n_bins; i++)
+            {
+                if (info.bin_map[i] >= 0)
+                    kept[info.bin_map[i]] = values[i];
+            }
+            check(in[x] == (agrees && presolved.contains(kept)), "presolve keeps the assignments");
+        }
+    }
+}
+
+void check_count()
+{
+    const int n_bins = 4;
+    std::mt19937 gen(3);
+    for (int trial=0; trial<50; trial++)
+    {
+        // counts against the leaves and count_by_variable
+        Tree tree = random_tree(n_bins, gen);
+        std::vector<std::pair<size_t, size_t>> counts = tree.count_by_variable();
+        for (int i=0; i<n_bins; i++)
+        {
+            for (bool value : {false, true})
+            {
+                size_t brute = 0;
+                for (const auto& leaf : tree.get_leaf_bins())
+                    brute += std::count(leaf.begin(), leaf.end(), std::make_pair(i, value));
+                check(tree.count({{i, value}}) == brute, "count");
+                check((value ? counts[i].second : counts[i].first) == brute, "count_by_variable");
+            }
+        }
+    }
+}
+
+void check_weights()
+{
+    const int n_bins = 5;
+    std::mt19937 gen(14);
+    for (int trial=0; trial<50; trial++)
+    {
+        Tree tree = random_tree(n_bins, gen);
+        size_t n_leaves = tree.get_n_leaves();
+        if (n_leaves == 0)
+            continue;
+
+        // weights with ties, weights[k] belongs to the k-th leaf
+        std::vector<double> weights;
+        for (size_t k=0; k<n_leaves; k++)
+            weights.push_back(static_cast<double>(gen() % 20));
+        tree.set_leaf_weights(weights);
+        std::vector<double> sorted_weights(weights);
+        std::sort(sorted_weights.begin(), sorted_weights.end());
+
+        for (size_t k : {size_t(0), size_t(1), size_t(3), n_leaves, n_leaves + 5})
+        {
+            std::vector<TreeNode*> best = tree.top_k(k);
+            std::set<TreeNode*> distinct(best.begin(), best.end());
+            bool ok = best.size() == std::min(k, n_leaves) && distinct.size() == best.size();
+            for (size_t i=0; ok && i<best.size(); i++)
+                ok = !best[i]->firstchild && tree.get_leaf_weight(best[i]) == sorted_weights[i];
+            check(ok, "top_k");
+        }
+
+        double threshold = static_cast<double>(gen() % 20);
+        std::set<size_t> below; // leaf ranks
+        for (TreeNode* leaf : tree.leaves_below(threshold))
+            below.insert(tree.rank(leaf));
+        std::set<size_t> expected;
+        for (size_t k=0; k<n_leaves; k++)
+            if (weights[k] < threshold)
+                expected.insert(k);
+        check(below == expected, "leaves_below");
+
+        // a changed weight is seen by the subtree minima
+        TreeNode* leaf = tree.top_k(n_leaves)[gen() % n_leaves];
+        tree.set_leaf_weight(leaf, -1.0);
+        check(tree.top_k(1) == std::vector<TreeNode*>{leaf}, "top_k after set_leaf_weight");
+        weights[tree.rank(leaf)] = -1.0;
+
+        // prune_above keeps the leaves at most threshold, in order
+        std::vector<std::vector<std::pair<int, bool>>> leaf_bins = tree.get_leaf_bins();
+        std::vector<std::vector<std::pair<int, bool>>> kept;
+        std::vector<double> kept_weights;
+        for (size_t k=0; k<n_leaves; k++)
+            if (weights[k] <= threshold)
+            {
+                kept.push_back(leaf_bins[k]);
+                kept_weights.push_back(weights[k]);
+            }
+        check(tree.prune_above(threshold) == n_leaves - kept.size(), "prune_above returns the leaves removed");
+        check(tree.get_leaf_bins() == kept, "prune_above leaves");
+        bool ok = true;
+        for (size_t k=0; k<kept.size(); k++)
+            ok = ok && tree.get_leaf_weight(tree.select_leaf(k)) == kept_weights[k];
+        check(ok, "weights after prune_above");
+    }
+}
+
+size_t subtree_size(const TreeNode* node)
+{
+    size_t size = 1;
+    for (const TreeNode* child = node->firstchild; child; child = child->nextsibling)
+        size += subtree_size(child);
+    return size;
+}
+
+void check_prune_stats()
+{
+    const int n_bins = 5;
+    std::mt19937 gen(15);
+    for (int trial=0; trial<50; trial++)
+    {
+        Tree tree = random_tree(n_bins, gen);
+        check(tree.get_prune_stats().size() == n_bins, "prune stats have one entry per binary");
+        std::vector<PruneStats> expected(n_bins);
+        while (tree.get_n_leaves() > 0)
+        {
+            // a whole branch below the root, counted on its binary
+            TreeNode* branch = tree.get_root()->firstchild;
+            if (gen() % 4 == 0 && branch->firstchild)
+            {
+                expected[branch->ind].n_prunes++;
+                expected[branch->ind].nodes_removed += subtree_size(branch);
+                expected[branch->ind].leaves_removed += branch->n_leaves;
+                tree.prune(branch);
+            }
+            else
+            {
+                // or a leaf, which takes the nodes up to the first prefix it shares with no other leaf. Every
+                // binary on its path is counted
+                std::vector<std::vector<std::pair<int, bool>>> leaf_bins = tree.get_leaf_bins();
+                size_t k = gen() % leaf_bins.size();
+                const std::vector<std::pair<int, bool>>& leaf = leaf_bins[k];
+                size_t depth = 1;
+                while (std::count_if(leaf_bins.begin(), leaf_bins.end(), [&](const std::vector<std::pair<int, bool>>& other)
+                    {
+                        return std::equal(leaf.begin(), leaf.begin() + depth, other.begin());
+                    }) > 1)
+                    depth++;
+                for (const auto& bin : leaf)
+                {
+                    expected[bin.first].n_prunes++;
+                    expected[bin.first].nodes_removed += leaf.size() - depth + 1;
+                    expected[bin.first].leaves_removed++;
+                }
+                tree.prune_leaves({static_cast<int>(k)});
+            }
+
+            bool ok = true;
+            for (int i=0; i<n_bins; i++)
+            {
+                const PruneStats& stats = tree.get_prune_stats()[i];
+                ok = ok && stats.n_prunes == expected[i].n_prunes && stats.nodes_removed == expected[i].nodes_removed
+                     && stats.leaves_removed == expected[i].leaves_removed;
+                if (stats.n_prunes > 0)
+                    ok = ok && std::abs(stats.avg_nodes_removed - static_cast<double>(stats.nodes_removed) / stats.n_prunes) < 1e-9
+                         && std::abs(stats.avg_leaves_removed - static_cast<double>(stats.leaves_removed) / stats.n_prunes) < 1e-9;
+            }
+            check(ok, "prune stats");
+        }
+
+        // copies keep the statistics, clearing keeps one entry per binary
+        Tree copy(tree);
+        check(copy.get_prune_stats().size() == n_bins && copy.get_prune_stats()[0].n_prunes == expected[0].n_prunes, "copied prune stats");
+        copy.clear_prune_stats();
+        check(copy.get_prune_stats().size() == n_bins && copy.get_prune_stats()[0].n_prunes == 0, "cleared prune stats");
+    }
+}
+
+// smallest leaf weight below node
+double min_leaf_weight(const Tree& tree, const TreeNode* node)
+{
+    std::vector<const TreeNode*> leaves;
+    preorder_leaves(node, leaves);
+    double weight = tree.get_leaf_weight(leaves[0]);
+    for (const TreeNode* leaf : leaves)
+        weight = std::min(weight, tree.get_leaf_weight(leaf));
+    return weight;
+}
+
+// siblings everywhere below node come in pruning order, fewer prunes first, then smaller weights
+bool siblings_ordered(const Tree& tree, const TreeNode* node)
+{
+    for (const TreeNode* child = node->firstchild; child; child = child->nextsibling)
+    {
+        const TreeNode* next = child->nextsibling;
+        if (next && (next->n_pruned < child->n_pruned
+            || (next->n_pruned == child->n_pruned && min_leaf_weight(tree, next) < min_leaf_weight(tree, child))))
+            return false;
+        if (!siblings_ordered(tree, child))
+            return false;
+    }
+    return true;
+}
+
+void order_all_children(Tree& tree, TreeNode* node)
+{
+    tree.order_children(node);
+    for (TreeNode* child = node->firstchild; child; child = child->nextsibling)
+        order_all_children(tree, child);
+}
+
+void check_order()
+{
+    const int n_bins = 5;
+    std::mt19937 gen(16);
+    for (int trial=0; trial<30; trial++)
+    {
+        Tree tree = random_tree(n_bins, gen);
+        size_t n_leaves = tree.get_n_leaves();
+        if (n_leaves < 2)
+            continue;
+        std::vector<double> weights;
+        for (size_t k=0; k<n_leaves; k++)
+            weights.push_back(static_cast<double>(gen() % 10));
+        tree.set_leaf_weights(weights);
+
+        // weight of every assignment, moved along with its leaf
+        std::map<std::vector<std::pair<int, bool>>, double> weight_of;
+        std::vector<std::vector<std::pair<int, bool>>> leaf_bins = tree.get_leaf_bins();
+        for (size_t k=0; k<n_leaves; k++)
+            weight_of[leaf_bins[k]] = weights[k];
+
+        order_all_children(tree, tree.get_root());
+        check(siblings_ordered(tree, tree.get_root()), "order_children by weight");
+
+        // prunes move the survivors on the pruned path back, prunes with adaptive order off are caught up
+        // by order_children
+        std::map<std::vector<std::pair<int, bool>>, uint32_t> n_pruned; // by path
+        for (bool adaptive : {true, false})
+        {
+            tree.set_adaptive_order(adaptive);
+            for (int i=0; i<3 && tree.get_n_leaves() > 1; i++)
+            {
+                leaf_bins = tree.get_leaf_bins();
+                size_t k = gen() % leaf_bins.size();
+                const std::vector<std::pair<int, bool>> leaf = leaf_bins[k];
+                size_t depth = 1;
+                while (std::count_if(leaf_bins.begin(), leaf_bins.end(), [&](const std::vector<std::pair<int, bool>>& other)
+                    {
+                        return std::equal(leaf.begin(), leaf.begin() + depth, other.begin());
+                    }) > 1)
+                    depth++;
+                for (size_t d=0; d<depth; d++)
+                    n_pruned[std::vector<std::pair<int, bool>>(leaf.begin(), leaf.begin() + d)]++;
+                weight_of.erase(leaf);
+                tree.prune_leaves({static_cast<int>(k)});
+
+                if (adaptive)
+                    check(siblings_ordered(tree, tree.get_root()), "adaptive order after a prune");
+                std::vector<const TreeNode*> leaves;
+                preorder_leaves(tree.get_root(), leaves);
+                leaf_bins = tree.get_leaf_bins();
+                bool ok = leaves.size() == weight_of.size() && leaf_bins.size() == weight_of.size();
+                for (size_t j=0; ok && j<leaves.size(); j++)
+                    ok = tree.select_leaf(j) == leaves[j] && tree.get_leaf_bins(leaves[j]) == leaf_bins[j]
+                         && weight_of.count(leaf_bins[j]) && tree.get_leaf_weight(leaves[j]) == weight_of[leaf_bins[j]];
+                check(ok, "leaves stay in preorder with their weights");
+            }
+        }
+        order_all_children(tree, tree.get_root());
+        check(siblings_ordered(tree, tree.get_root()), "order_children by prunes and weight");
+
+        // survivors count the prunes below them
+        std::vector<const TreeNode*> path;
+        std::vector<std::vector<const TreeNode*>> paths;
+        node_paths(tree.get_root(), path, paths);
+        bool ok = true;
+        for (const auto& node_path : paths)
+        {
+            std::vector<std::pair<int, bool>> bins = tree.get_leaf_bins(node_path.back());
+            ok = ok && node_path.back()->n_pruned == (n_pruned.count(bins) ? n_pruned[bins] : 0);
+        }
+        check(ok, "prune counts of the survivors");
+    }
+}
+
+// select_leaf and rank follow the preorder walk
+void check_preorder_walk(const Tree& tree, const std::string& what)
+{
+    std::vector<const TreeNode*> leaves;
+    if (tree.get_n_leaves() > 0)
+        preorder_leaves(tree.get_root(), leaves);
+    bool ok = leaves.size() == tree.get_n_leaves();
+    for (size_t k=0; ok && k<leaves.size(); k++)
+        ok = tree.select_leaf(k) == leaves[k] && tree.rank(leaves[k]) == k;
+    check(ok, what);
+}
+
+void check_select()
+{
+    const int n_bins = 5;
+    std::mt19937 gen(18);
+    for (int trial=0; trial<30; trial++)
+    {
+        Tree tree = random_tree(n_bins, gen);
+        check_preorder_walk(tree, "select_leaf and rank");
+        for (int i=0; i<3 && tree.get_n_leaves() > 0; i++)
+        {
+            tree.prune_leaves({static_cast<int>(gen() % tree.get_n_leaves())});
+            std::vector<bool> values = assignment(n_bins, gen() % (1 << n_bins));
+            std::vector<std::pair<int, bool>> leaf;
+            for (int j=0; j<n_bins; j++)
+                leaf.push_back(std::make_pair(j, values[j]));
+            tree.insert_leaf(leaf);
+            check_preorder_walk(tree, "select_leaf and rank after prune and insert");
+        }
+        if (tree.get_n_leaves() > 0)
+        {
+            tree.reorder();
+            check_preorder_walk(tree, "select_leaf and rank after reorder");
+        }
+    }
+    check_preorder_walk(hcat({Tree::exactly_one(3), Tree(0, true, 1), Tree::exactly_one(2)}), "select_leaf and rank on hcat");
+
+    // out of range and internal nodes
+    Tree tree = Tree::exactly_one(3);
+    bool threw = false;
+    try
+    {
+        tree.select_leaf(tree.get_n_leaves());
+    }
+    catch (const std::out_of_range&)
+    {
+        threw = true;
+    }
+    check(threw, "select_leaf past the last leaf");
+    threw = false;
+    try
+    {
+        tree.rank(tree.get_root());
+    }
+    catch (const std::invalid_argument&)
+    {
+        threw = true;
+    }
+    check(threw, "rank of an internal node");
+}
+
+// every node owns the contiguous slice of the preorder leaves below it, and the leaf list follows the walk
+void check_leaf_slices(const Tree& tree, const std::string& what)
+{
+    check_preorder_walk(tree, what);
+    std::vector<const TreeNode*> leaves;
+    preorder_leaves(tree.get_root(), leaves);
+    std::vector<const TreeNode*> path;
+    std::vector<std::vector<const TreeNode*>> paths;
+    node_paths(tree.get_root(), path, paths);
+    bool ok = tree.get_leaf_bins().size() == tree.get_n_leaves();
+    for (size_t k=0; ok && k<tree.get_n_leaves(); k++)
+        ok = tree.get_leaf_bins()[k] == tree.get_leaf_bins(leaves[k]);
+    for (const auto& node_path : paths)
+    {
+        std::vector<const TreeNode*> below;
+        preorder_leaves(node_path.back(), below);
+        std::pair<size_t, size_t> range = tree.leaf_range(node_path.back());
+        ok = ok && range.second - range.first == below.size() && range.second <= leaves.size()
+             && std::equal(below.begin(), below.end(), leaves.begin() + range.first);
+    }
+    check(ok, what);
+}
+
+void check_leaf_ranges()
+{
+    const int n_bins = 5;
+    std::mt19937 gen(19);
+    for (int trial=0; trial<50; trial++)
+    {
+        Tree tree = random_tree(n_bins, gen);
+        if (tree.get_n_leaves() < 2)
+            continue;
+        bool adaptive = trial % 2;
+        if (adaptive)
+        {
+            // sifting moves the slices of the survivors
+            std::vector<double> weights;
+            for (size_t k=0; k<tree.get_n_leaves(); k++)
+                weights.push_back(static_cast<double>(gen() % 10));
+            tree.set_leaf_weights(weights);
+            tree.set_adaptive_order();
+        }
+        check_leaf_slices(tree, "leaf slices");
+
+        while (tree.get_n_leaves() > 0)
+        {
+            std::vector<std::vector<std::pair<int, bool>>> kept = tree.get_leaf_bins();
+            size_t begin = gen() % kept.size();
+            size_t end = begin + 1 + gen() % std::min<size_t>(kept.size() - begin, 4);
+            kept.erase(kept.begin() + begin, kept.begin() + end);
+            tree.prune_leaves(begin, end);
+            if (adaptive)
+            {
+                std::vector<std::vector<std::pair<int, bool>>> leaves = tree.get_leaf_bins();
+                std::sort(kept.begin(), kept.end());
+                std::sort(leaves.begin(), leaves.end());
+                check(leaves == kept, "prune_leaves of a range with adaptive order");
+            }
+            else
+                check(tree.get_leaf_bins() == kept, "prune_leaves of a range");
+            check(tree.get_n_nodes() == Tree(kept).get_n_nodes(), "prune_leaves of a range removes the unused nodes");
+            if (tree.get_n_leaves() > 0)
+                check_leaf_slices(tree, "leaf slices after prune_leaves of a range");
+        }
+    }
+
+    // the slice of a subtree is pruned as a whole, one prune on the binary of its top node
+    Tree full = Tree::exactly_one(4);
+    const TreeNode* branch = full.get_root()->firstchild;
+    int ind = branch->ind;
+    std::pair<size_t, size_t> range = full.leaf_range(branch);
+    full.prune_leaves(range.first, range.second);
+    check(range.second - range.first > 1 && full.get_prune_stats()[ind].n_prunes == 1
+          && full.get_prune_stats()[ind].leaves_removed == range.second - range.first,
+          "prune_leaves of a subtree slice prunes the subtree");
+
+    Tree tree = Tree::exactly_one(3);
+    tree.prune_leaves(1, 1);
+    check(tree.get_n_leaves() == 3, "prune_leaves of an empty range");
+    bool threw = false;
+    try
+    {
+        tree.prune_leaves(2, 4);
+    }
+    catch (const std::out_of_range&)
+    {
+        threw = true;
+    }
+    check(threw && tree.get_n_leaves() == 3, "prune_leaves of a range past the last leaf");
+}
+
+// is_ancestor of every pair of nodes against the root paths
+void check_is_ancestor(const Tree& tree, const std::string& what)
+{
+    std::vector<const TreeNode*> path;
+    std::vector<std::vector<const TreeNode*>> paths;
+    node_paths(tree.get_root(), path, paths);
+    bool ok = true;
+    for (const auto& path1 : paths)
+        for (const auto& path2 : paths)
+            ok = ok && tree.is_ancestor(path1.back(), path2.back()) == (std::find(path2.begin(), path2.end(), path1.back()) != path2.end());
+    check(ok, what);
+}
+
+void check_labels()
+{
+    const int n_bins = 6;
+    std::mt19937 gen(20);
+    for (int trial=0; trial<10; trial++)
+    {
+        // grown one leaf at a time, so new subtrees are labelled into the gaps of their neighbours
+        Tree tree({{{0, false}, {1, false}, {2, false}, {3, false}, {4, false}, {5, false}}});
+        tree.track_preorder_labels();
+        tree.set_adaptive_order(trial % 2);
+        check_is_ancestor(tree, "is_ancestor");
+        for (int i=0; i<60; i++)
+        {
+            std::vector<bool> values = assignment(n_bins, gen() % (1 << n_bins));
+            std::vector<std::pair<int, bool>> leaf;
+            for (int j=0; j<n_bins; j++)
+                leaf.push_back(std::make_pair(j, values[j]));
+            if (i % 10 == 9)
+                leaf.resize(2 + gen() % 3); // a prefix turns its node into a leaf
+            if (i % 10 == 4)
+                tree.insert_leaves({leaf, std::vector<std::pair<int, bool>>(leaf.rbegin(), leaf.rend())});
+            else
+                tree.insert_leaf(leaf);
+            if (i % 3 == 2 && tree.get_n_leaves() > 1)
+                tree.prune_leaves({static_cast<int>(gen() % tree.get_n_leaves())});
+            check_is_ancestor(tree, "is_ancestor after insert_leaf and prunes");
+        }
+
+        Tree copy(tree);
+        check_is_ancestor(copy, "is_ancestor in a copy");
+        tree.shrink_to_fit();
+        check_is_ancestor(tree, "is_ancestor after shrink_to_fit");
+        tree.track_preorder_labels(false);
+        check_is_ancestor(tree, "is_ancestor without labels");
+    }
+}
+
+void check_insert_leaf()
+{
+    const int n_bins = 4;
+    std::mt19937 gen(4);
+    for (int trial=0; trial<50; trial++)
+    {
+        Tree tree = random_tree(n_bins, gen);
+        if (tree.get_n_leaves() == 0)
+            continue;
+
+        // an assignment already in the tree is rejected in any bin order
+        std::vector<std::pair<int, bool>> leaf = tree.get_leaf_bins()[0];
+        std::reverse(leaf.begin(), leaf.end());
+        size_t n_leaves = tree.get_n_leaves();
+        check(!tree.insert_leaf(leaf) && tree.get_n_leaves() == n_leaves, "insert_leaf rejects a reordered duplicate");
+
+        // a shorter assignment adds its whole cube, a prefix of existing leaves replaces them
+        std::vector<bool> in = members(tree);
+        std::vector<std::pair<int, bool>> bins = tree.get_leaf_bins()[gen() % n_leaves];
+        bins.resize(1 + gen() % 2);
+        if (gen() % 2)
+            bins[0].second = !bins[0].second;
+        tree.insert_leaf(bins);
+        check(tree.get_n_leaves() == tree.get_leaf_bins().size(), "insert_leaf leaf count");
+        std::vector<bool> inserted = members(tree);
+        for (int x=0; x<(1 << n_bins); x++)
+        {
+            bool cube = true;
+            for (const auto& bin : bins)
+                cube = cube && assignment(n_bins, x)[bin.first] == bin.second;
+            check(inserted[x] == (in[x] || cube), "insert_leaf adds the assignment");
+        }
+    }
+
+    // prefix of an existing leaf
+    Tree prefix({{{0, true}, {1, false}}});
+    check(prefix.insert_leaf({{0, true}}) && leaf_set(prefix) == std::vector<std::vector<std::pair<int, bool>>>{{{0, true}}}, "insert_leaf of a prefix");
+
+    // insertion next to a labelled root leaf
+    Tree single(0, true, 1);
+    check(single.insert_leaf({{0, false}}), "insert_leaf next to a labelled root");
+    check(leaf_set(single) == std::vector<std::vector<std::pair<int, bool>>>{{{0, false}}, {{0, true}}}, "insert_leaf leaves");
+    check(!single.insert_leaf({{0, true}}), "insert_leaf rejects the root leaf");
+
+    // invalid input leaves the tree as it was
+    single = Tree(0, true, 2);
+    bool threw = false;
+    try
+    {
+        single.insert_leaf({{1, true}, {1, false}});
+    }
+    catch (const std::invalid_argument&)
+    {
+        threw = true;
+    }
+    check(threw && leaf_set(single) == std::vector<std::vector<std::pair<int, bool>>>{{{0, true}}}, "insert_leaf validates before changing the tree");
+}
+
+void check_constraints()
+{
+    // random clauses and one linear constraint against evaluating every assignment
+    const int n_bins = 5;
+    std::mt19937 gen(7);
+    for (int trial=0; trial<50; trial++)
+    {
+        std::vector<std::vector<std::pair<int, bool>>> clauses(gen() % 4);
+        for (auto& clause : clauses)
+        {
+            for (int k=0; k<2; k++)
+                clause.push_back(std::make_pair(static_cast<int>(gen() % n_bins), gen() % 2 == 1));
+        }
+        LinearConstraint constraint;
+        for (int i=0; i<n_bins; i++)
+            constraint.coeffs.push_back(std::make_pair(i, static_cast<double>(static_cast<int>(gen() % 5) - 2)));
+        constraint.lb = static_cast<double>(static_cast<int>(gen() % 5) - 3);
+        constraint.ub = constraint.lb + gen() % 4;
+
+        Tree tree(n_bins, clauses, {constraint});
+        check(tree.get_n_leaves() == tree.get_leaf_bins().size(), "constraint tree leaf count");
+        std::vector<bool> in = members(tree);
+        for (int x=0; x<(1 << n_bins); x++)
+        {
+            std::vector<bool> values = assignment(n_bins, x);
+            bool feasible = true;
+            for (const auto& clause : clauses)
+            {
+                bool satisfied = false;
+                for (const auto& literal : clause)
+                    satisfied = satisfied || values[literal.first] == literal.second;
+                feasible = feasible && satisfied;
+            }
+            double sum = 0.0;
+            for (const auto& coeff : constraint.coeffs)
+                sum += coeff.second * values[coeff.first];
+            feasible = feasible && constraint.lb <= sum && sum <= constraint.ub;
+            check(in[x] == feasible, "constraint tree");
+        }
+    }
+
+    // no binaries cannot be represented
+    bool threw = false;
+    try
+    {
+        Tree(0, {});
+    }
+    catch (const std::invalid_argument&)
+    {
+        threw = true;
+    }
+    check(threw, "constraint tree rejects zero binaries");
+}
+
+void check_cardinality()
+{
+    // generators against counting the true binaries of every assignment
+    for (int n_bins=1; n_bins<=5; n_bins++)
+    {
+        for (int lb=-1; lb<=n_bins+1; lb++)
+        {
+            for (int ub=lb; ub<=n_bins+1; ub++)
+            {
+                Tree tree = Tree::cardinality(n_bins, lb, ub);
+                check(tree.get_n_leaves() == tree.get_leaf_bins().size(), "cardinality leaf count");
+                std::vector<bool> in = members(tree);
+                for (int x=0; x<(1 << n_bins); x++)
+                {
+                    int n_true = 0;
+                    for (int i=0; i<n_bins; i++)
+                        n_true += (x >> i) & 1;
+                    check(in[x] == (lb <= n_true && n_true <= ub), "cardinality");
+                }
+            }
+        }
+    }
+
+    // no binaries cannot be represented
+    bool threw = false;
+    try
+    {
+        Tree::exactly_k(0, 0);
+    }
+    catch (const std::invalid_argument&)
+    {
+        threw = true;
+    }
+    check(threw, "cardinality rejects zero binaries");
+}
+
+void check_alternatives()
+{
+    std::mt19937 gen(6);
+    for (int trial=0; trial<20; trial++)
+    {
+        std::vector<Tree> trees;
+        while (trees.size() < 4)
+        {
+            Tree tree = random_tree(2, gen);
+            if (tree.get_n_leaves() > 0)
+                trees.push_back(tree);
+        }
+
+        // adding alternatives one at a time builds the hcat tree
+        Tree tree;
+        for (const Tree& alt : trees)
+            tree.add_alternative(Tree(alt));
+        check(tree.get_n_bins() == hcat(trees).get_n_bins() && leaf_set(tree) == leaf_set(hcat(trees)), "add_alternative");
+
+        // removing one and renumbering builds the hcat tree of the others
+        size_t i = gen() % trees.size();
+        tree.remove_alternative(i);
+        check(tree.get_n_leaves() == tree.get_leaf_bins().size(), "remove_alternative leaf count");
+        trees.erase(trees.begin() + i);
+        tree.renumber_alternatives();
+        Tree expected = hcat(trees);
+        check(tree.get_n_bins() == expected.get_n_bins() && members(tree) == members(expected), "remove_alternative and renumber_alternatives");
+        check(tree.get_alternatives().size() == trees.size(), "alternatives after removal");
+    }
+}
+
+// leaves without the indicator binaries, the other binaries renumbered densely
+std::vector<std::vector<std::pair<int, bool>>> strip_indicators(const Tree& tree, const std::vector<bool>& indicator)
+{
+    std::vector<int> bin_map(indicator.size(), -1);
+    int n_kept = 0;
+    for (size_t i=0; i<indicator.size(); i++)
+        if (!indicator[i])
+            bin_map[i] = n_kept++;
+    std::vector<std::vector<std::pair<int, bool>>> leaves = tree.get_leaf_bins();
+    for (auto& leaf : leaves)
+    {
+        leaf.erase(std::remove_if(leaf.begin(), leaf.end(), [&](const std::pair<int, bool>& bin) { return indicator[bin.first]; }), leaf.end());
+        for (auto& bin : leaf)
+            bin.first = bin_map[bin.first];
+    }
+    return leaves;
+}
+
+void check_flatten()
+{
+    std::mt19937 gen(17);
+    Tree a = Tree::exactly_one(2);
+    Tree b(0, true, 1);
+    Tree c = random_tree(2, gen);
+    c.insert_leaf({{0, false}, {1, false}});
+
+    // a nested disjunction has the layout of the flat one
+    for (HcatEncoding encoding : {HcatEncoding::OneHot, HcatEncoding::Logarithmic})
+    {
+        Tree nested = hcat({hcat({a, b}, encoding), c}, encoding);
+        Tree flat = hcat({a, b, c}, encoding);
+        check(nested.get_alternatives().size() == 3 && nested.get_n_bins() == flat.get_n_bins(), "flattened alternatives");
+        check(nested == flat && nested.get_leaf_bins() == flat.get_leaf_bins(), "flattened hcat equals the flat hcat");
+    }
+
+    // repeated doubling keeps a single indicator level, the unflattened tree nests one level per doubling but
+    // holds the same leaves once the indicators are dropped
+    Tree tree = a;
+    Tree unflattened = a;
+    std::vector<bool> nested_indicator(a.get_n_bins(), false); // indicator binaries of the unflattened tree
+    for (int level=1; level<=4; level++)
+    {
+        tree = hcat({tree, tree});
+        unflattened = hcat({unflattened, unflattened}, HcatEncoding::OneHot, false);
+        std::vector<bool> doubled(nested_indicator);
+        doubled.push_back(true);
+        doubled.insert(doubled.end(), nested_indicator.begin(), nested_indicator.end());
+        doubled.push_back(true);
+        nested_indicator = doubled;
+
+        std::vector<bool> indicator(tree.get_n_bins(), false);
+        for (const Alternative& alt : tree.get_alternatives())
+            indicator[alt.indicator] = true;
+        check(tree.get_alternatives().size() == (size_t(1) << level), "one alternative per copy");
+        check(tree.get_n_bins() == unflattened.get_n_bins() - ((size_t(1) << level) - 2), "only the outer indicators remain");
+        bool ok = true;
+        for (const auto& leaf : tree.get_leaf_bins())
+            ok = ok && std::count_if(leaf.begin(), leaf.end(), [&](const std::pair<int, bool>& bin) { return indicator[bin.first]; }) == 1;
+        check(ok, "every leaf tests one indicator");
+        check(tree.get_n_leaves() == unflattened.get_n_leaves()
+              && strip_indicators(tree, indicator) == strip_indicators(unflattened, nested_indicator), "flattened leaves match the nested ones");
+    }
+}
+
+void check_symmetries()
+{
+    std::mt19937 gen(8);
+    for (int trial=0; trial<20; trial++)
+    {
+        // alternatives drawn from a small pool, classes are the alternatives with the same leaves
+        std::vector<Tree> pool;
+        while (pool.size() < 3)
+        {
+            Tree tree = random_tree(2, gen);
+            if (tree.get_n_leaves() > 1)
+                pool.push_back(tree);
+        }
+        std::vector<size_t> picks;
+        std::vector<Tree> trees;
+        for (int i=0; i<6; i++)
+        {
+            picks.push_back(gen() % pool.size());
+            trees.push_back(pool[picks.back()]);
+        }
+        Tree tree = hcat(trees);
+        std::vector<std::vector<size_t>> classes = tree.detect_symmetries();
+        for (const auto& symmetry_class : classes)
+        {
+            for (size_t j : symmetry_class)
+                check(leaf_set(trees[j]) == leaf_set(trees[symmetry_class[0]]), "symmetric alternatives have the same leaves");
+        }
+        size_t n_pairs = 0;
+        for (size_t i=0; i<trees.size(); i++)
+        {
+            for (size_t j=0; j<trees.size(); j++)
+                n_pairs += leaf_set(trees[i]) == leaf_set(trees[j]);
+        }
+        size_t n_class_pairs = 0;
+        for (const auto& symmetry_class : classes)
+            n_class_pairs += symmetry_class.size() * symmetry_class.size();
+        check(n_pairs == n_class_pairs, "every pair of equal alternatives is in one class");
+
+        // one branch per class from the root
+        std::vector<BranchInfo> branches = tree.get_branch_info(tree.get_root(), true);
+        std::vector<int> indicators, expected;
+        for (const BranchInfo& info : branches)
+            indicators.push_back(info.node->ind);
+        for (const auto& symmetry_class : classes)
+            expected.push_back(tree.get_alternatives()[symmetry_class[0]].indicator);
+        std::sort(indicators.begin(), indicators.end());
+        std::sort(expected.begin(), expected.end());
+        check(indicators == expected, "get_branch_info returns one representative per class");
+
+        // an orbit prune removes the same branch below every member of the class
+        size_t i = gen() % trees.size();
+        const Alternative& alt = tree.get_alternatives()[i];
+        TreeNode* node = tree.get_root()->firstchild;
+        while (node->ind != alt.indicator)
+            node = node->nextsibling;
+        node = node->firstchild; // first binary of the alternative
+        std::pair<int, bool> branch = std::make_pair(node->ind - alt.offset, node->value);
+        std::vector<size_t> orbit;
+        for (const auto& symmetry_class : classes)
+        {
+            if (std::find(symmetry_class.begin(), symmetry_class.end(), i) != symmetry_class.end())
+                orbit = symmetry_class;
+        }
+        std::vector<std::vector<std::pair<int, bool>>> remaining;
+        for (const auto& leaf : leaf_set(tree))
+        {
+            bool pruned = false;
+            for (size_t j : orbit)
+            {
+                const Alternative& other = tree.get_alternatives()[j];
+                pruned = pruned || (std::count(leaf.begin(), leaf.end(), std::make_pair(other.indicator, true))
+                    && std::count(leaf.begin(), leaf.end(), std::make_pair(branch.first + other.offset, branch.second)));
+            }
+            if (!pruned)
+                remaining.push_back(leaf);
+        }
+        tree.prune(node, true);
+        check(leaf_set(tree) == remaining, "orbit prune");
+        check(tree.get_symmetry_classes() == classes, "orbit prune keeps the classes");
+
+        // a plain prune breaks the symmetry
+        tree.prune(tree.get_root()->firstchild);
+        check(tree.get_symmetry_classes().empty(), "plain prune drops the classes");
+    }
+}
+
+// leaves of the subtree in preorder
+// every node on the path is an ancestor of the nodes below it
+void check_ancestors(const Tree& tree, const TreeNode* node, std::vector<const TreeNode*>& path)
+{
+    for (const TreeNode* prev : path)
+        check(tree.is_ancestor(prev, node), "labels after compaction");
+    path.push_back(node);
+    for (const TreeNode* child = node->firstchild; child; child = child->nextsibling)
+        check_ancestors(tree, child, path);
+    path.pop_back();
+}
+
+void check_shrink()
+{
+    const int n_bins = 12;
+    std::mt19937 gen(9);
+    for (int trial=0; trial<4; trial++)
+    {
+        Tree tree = Tree::at_most_k(n_bins, 6);
+        tree.track_implied_fixings();
+        tree.track_preorder_labels();
+        std::vector<double> weights;
+        for (size_t i=0; i<tree.get_n_leaves(); i++)
+            weights.push_back(static_cast<double>(gen() % 100));
+        tree.set_leaf_weights(weights);
+
+        // prune most leaves so that the pool is compacted by the prune itself, or by hand
+        std::vector<std::vector<bool>> kept;
+        std::vector<double> kept_weights;
+        size_t begin = 40 + gen() % 40;
+        std::vector<std::vector<std::pair<int, bool>>> all_bins = tree.get_leaf_bins();
+        for (size_t i=begin; i<begin+20; i++)
+        {
+            std::vector<bool> values(n_bins, false);
+            for (const auto& bin : all_bins[i])
+                values[bin.first] = bin.second;
+            kept.push_back(values);
+            kept_weights.push_back(weights[i]);
+        }
+        const TreeNode* old_root = tree.get_root();
+        if (trial % 2)
+            tree.set_auto_shrink(0.5);
+        tree.prune_leaves(begin + 20, tree.get_n_leaves());
+        tree.prune_leaves(0, begin);
+        if (trial % 2)
+            check(tree.get_root() != old_root, "auto shrink compacts the pool");
+        else
+            check(tree.shrink_to_fit() > 0, "shrink_to_fit gives memory back");
+
+        // leaves in preorder, with their weights
+        std::vector<const TreeNode*> leaves;
+        preorder_leaves(tree.get_root(), leaves);
+        std::vector<std::vector<std::pair<int, bool>>> leaf_bins = tree.get_leaf_bins();
+        check(leaves.size() == kept.size() && tree.get_n_leaves() == kept.size() && leaf_bins.size() == kept.size(), "leaves after compaction");
+        for (size_t k=0; k<leaves.size() && k<kept.size(); k++)
+        {
+            check(tree.select_leaf(k) == leaves[k] && tree.rank(leaves[k]) == k, "preorder after compaction");
+            check(tree.get_leaf_bins(leaves[k]) == leaf_bins[k], "leaf bins after compaction");
+            check(tree.find_leaf(kept[k]) == leaves[k] && tree.get_leaf_weight(leaves[k]) == kept_weights[k], "weights after compaction");
+            if (k > 0)
+                check(!tree.is_ancestor(leaves[k - 1], leaves[k]), "labels after compaction");
+        }
+        std::vector<const TreeNode*> path;
+        check_ancestors(tree, tree.get_root(), path);
+
+        // fixings against the kept leaves
+        for (const auto& bin : tree.get_global_fixings())
+        {
+            for (const auto& values : kept)
+                check(values[bin.first] == bin.second, "fixings after compaction");
+        }
+    }
+}
+
 int main()
 {
     std::stringstream ss;
@@ -21,5 +1353,34 @@ int main()
     std::cout << tree << std::endl;
     std::cout << "from forward propagation: " << std::endl << tree.print_propagated_leaves() << std::endl;
 
-    return 0;
+    std::cout << "leaves with (8, 1): " << tree.count({{8, true}}) << " of " << tree.get_n_leaves() << std::endl;
+
+    Tree log_tree = hcat({tree1, tree2, tree1}, HcatEncoding::Logarithmic);
+    std::cout << "logarithmic hcat: n_bins = " << log_tree.get_n_bins() << ", n_leaves = " << log_tree.get_n_leaves() << std::endl;
+
+    check_set_operations();
+    check_canonical();
+    check_reduce();
+    check_reorder();
+    check_project();
+    check_fixings();
+    check_presolve();
+    check_lca();
+    check_count();
+    check_weights();
+    check_prune_stats();
+    check_order();
+    check_select();
+    check_leaf_ranges();
+    check_labels();
+    check_insert_leaf();
+    check_constraints();
+    check_cardinality();
+    check_alternatives();
+    check_flatten();
+    check_symmetries();
+    check_shrink();
+    std::cout << "behaviour checks failed: " << n_failed << std::endl;
+
+    return n_failed ? 1 : 0;
 }
\ No newline at end of file